@@ -0,0 +1,42 @@
+#!/bin/bash
+#
+# Measures the throughput of pipelines made only of builtins with each builtin
+# stage in a child process and with QUASH_BUILTIN_THREADS running them as
+# threads connected by ring buffers.
+#
+# Usage: bench/builtin_pipeline.bash [COUNT] [STAGES]
+
+if [ ! -e "./quash" ]; then
+    echo "This script must be run from the top level quash directory"
+    exit 1
+fi
+
+COUNT=${1:-2000}
+STAGES=${2:-4}
+BENCH_DIR=$(mktemp -d)
+SCRIPT=$BENCH_DIR/builtin_pipeline.qsh
+
+trap 'rm -rf $BENCH_DIR' EXIT
+
+# One pipeline of STAGES echo builtins per line
+PIPELINE="echo stage0"
+for ((s = 1; s < STAGES; ++s)); do
+    PIPELINE="$PIPELINE | echo stage$s"
+done
+
+for ((i = 0; i < COUNT; ++i)); do
+    echo "$PIPELINE"
+done > $SCRIPT
+
+printf "%-10s %10s %15s\n" "MODE" "SECONDS" "PIPELINES/SEC"
+
+for threads in 0 1; do
+    mode=$([ $threads = 1 ] && echo threads || echo processes)
+
+    start=$(date +%s%N)
+    QUASH_BUILTIN_THREADS=$threads ./quash < $SCRIPT > /dev/null
+    end=$(date +%s%N)
+
+    awk -v m=$mode -v ns=$((end - start)) -v n=$COUNT \
+        'BEGIN { printf "%-10s %10.3f %15.0f\n", m, ns / 1e9, n / (ns / 1e9) }'
+done
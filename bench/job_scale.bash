@@ -0,0 +1,88 @@
+#!/bin/bash
+#
+# Starts thousands of background jobs from one script and measures how the
+# job table copes. Every job is a cat blocked opening the same FIFO, so all of
+# them stay alive until the script opens the FIFO for writing and then exit
+# together.
+#
+# Quash runs a small stamp program between the phases. It prints the wall
+# clock along with the CPU time and resident memory of its parent, which is
+# quash itself, so quash's own cost is measured and not that of the jobs.
+#
+# Usage: bench/job_scale.bash [JOBS...]
+
+if [ ! -e "./quash" ]; then
+    echo "This script must be run from the top level quash directory"
+    exit 1
+fi
+
+COUNTS=${@:-1000 10000}
+BENCH_DIR=$(mktemp -d)
+SCRIPT=$BENCH_DIR/job_scale.qsh
+FIFO=$BENCH_DIR/release
+STAMP=$BENCH_DIR/stamp
+
+trap 'rm -rf $BENCH_DIR' EXIT
+
+# Every job has to be running at once for the FIFO to release them, so the
+# job scheduler must not hold any back
+export QUASH_MAX_JOBS=0
+
+mkfifo $FIFO
+
+cat > $STAMP <<'EOF'
+#!/bin/sh
+read cpu rest < /proc/$PPID/schedstat
+rss=$(awk '/^VmRSS/ { print $2 }' /proc/$PPID/status)
+echo "STAMP $1 $(date +%s%N) $cpu $rss"
+EOF
+chmod +x $STAMP
+
+printf "%-7s %10s %10s %10s %10s %12s %8s\n" "JOBS" "LAUNCH MS" "JOBS/S" \
+       "BYTES/JOB" "JOBS MS" "REAP CPU MS" "MAX ID"
+
+for n in $COUNTS; do
+    {
+        echo "$STAMP start"
+        for ((i = 0; i < n; ++i)); do
+            echo "cat $FIFO &"
+        done
+        echo "$STAMP launched"
+        echo "$STAMP listing"
+        echo "jobs > /dev/null"
+        echo "$STAMP listed"
+        echo "sh -c 'exec 3> $FIFO'"
+        echo "$STAMP released"
+        echo "sleep 1"
+        echo "$STAMP reaped"
+    } > $SCRIPT
+
+    ./quash $SCRIPT > $BENCH_DIR/out 2> $BENCH_DIR/err
+
+    completed=$(grep -c '^Completed:' $BENCH_DIR/out)
+
+    if [ "$completed" -ne "$n" ]; then
+        echo "$n jobs: only $completed completed"
+        head -3 $BENCH_DIR/err
+        continue
+    fi
+
+    max_id=$(grep -o '^Background job started: \[[0-9]*\]' $BENCH_DIR/out \
+             | tr -dc '0-9\n' | sort -n | tail -1)
+
+    # The time between the listing and listed stamps minus that between two
+    # back to back stamps is what the jobs builtin took. Quash collects the
+    # exits while it waits for the releasing sh and the sleep, so its CPU time
+    # from listed to reaped is what reaping and reporting every job cost.
+    grep '^STAMP' $BENCH_DIR/out | awk -v n=$n -v max_id=$max_id '
+        { wall[$2] = $3; cpu[$2] = $4; rss[$2] = $5 }
+        END {
+            launch = (wall["launched"] - wall["start"]) / 1e6
+            stamp = wall["listing"] - wall["launched"]
+            list = (wall["listed"] - wall["listing"] - stamp) / 1e6
+            printf "%-7d %10.1f %10.0f %10.0f %10.2f %12.1f %8d\n", n, launch,
+                   n / launch * 1e3, (rss["launched"] - rss["start"]) * 1024 / n,
+                   (list > 0) ? list : 0, (cpu["reaped"] - cpu["listed"]) / 1e6,
+                   max_id
+        }'
+done
@@ -0,0 +1,45 @@
+#!/bin/bash
+#
+# Runs pipelines of many cat stages to check that long pipelines work and that
+# setting them up scales linearly. The last stage prints the time it started,
+# so the setup latency is the time from launching quash until every stage of
+# the pipeline is running.
+#
+# Usage: bench/long_pipeline.bash [STAGES...]
+
+if [ ! -e "./quash" ]; then
+    echo "This script must be run from the top level quash directory"
+    exit 1
+fi
+
+STAGES=${@:-10 100 1000 5000}
+DATE_BIN=$(command -v date)
+BENCH_DIR=$(mktemp -d)
+SCRIPT=$BENCH_DIR/long_pipeline.qsh
+
+trap 'rm -rf $BENCH_DIR' EXIT
+
+printf "%-8s %12s %14s %12s\n" "STAGES" "SETUP MS" "US/STAGE" "TOTAL MS"
+
+for n in $STAGES; do
+    {
+        printf "echo data"
+        for ((i = 0; i < n; ++i)); do
+            printf " | cat"
+        done
+        echo " | $DATE_BIN +%s%N"
+    } > $SCRIPT
+
+    start=$(date +%s%N)
+    last=$(./quash $SCRIPT)
+    end=$(date +%s%N)
+
+    if [ -z "$last" ]; then
+        echo "$n stages: pipeline failed"
+        continue
+    fi
+
+    awk -v n=$n -v setup=$((last - start)) -v total=$((end - start)) \
+        'BEGIN { printf "%-8d %12.2f %14.1f %12.2f\n", n, setup / 1e6,
+                 setup / 1e3 / n, total / 1e6 }'
+done
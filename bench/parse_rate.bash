@@ -0,0 +1,41 @@
+#!/bin/bash
+#
+# Measures how fast quash works through a large generated script when it is
+# given as a file argument, as a regular file on standard in and through a
+# pipe. Only the pipe is read through stdio.
+#
+# Usage: bench/parse_rate.bash [LINES]
+
+if [ ! -e "./quash" ]; then
+    echo "This script must be run from the top level quash directory"
+    exit 1
+fi
+
+LINES=${1:-200000}
+BENCH_DIR=$(mktemp -d)
+SCRIPT=$BENCH_DIR/parse_rate.qsh
+
+trap 'rm -rf $BENCH_DIR' EXIT
+
+# Builtins that run inside quash so the time goes to reading and parsing
+for ((i = 0; i < LINES; ++i)); do
+    echo "export QUASH_PARSE_BENCH=line_$i"
+done > $SCRIPT
+
+SIZE=$(stat -c %s $SCRIPT)
+
+printf "%-8s %10s %14s %10s\n" "INPUT" "SECONDS" "LINES/SEC" "MB/SEC"
+
+run() {
+    start=$(date +%s%N)
+    eval "$2" > /dev/null
+    end=$(date +%s%N)
+
+    awk -v m=$1 -v ns=$((end - start)) -v n=$LINES -v s=$SIZE \
+        'BEGIN { printf "%-8s %10.3f %14.0f %10.1f\n", m, ns / 1e9,
+                 n / (ns / 1e9), s / 1e6 / (ns / 1e9) }'
+}
+
+run argument "./quash $SCRIPT"
+run file "./quash < $SCRIPT"
+run pipe "cat $SCRIPT | ./quash"
@@ -0,0 +1,34 @@
+#!/bin/bash
+#
+# Measures how many short lived programs quash can launch per second with each
+# process creation backend selected by QUASH_SPAWN.
+#
+# Usage: bench/spawn_rate.bash [COUNT]
+
+if [ ! -e "./quash" ]; then
+    echo "This script must be run from the top level quash directory"
+    exit 1
+fi
+
+COUNT=${1:-5000}
+TRUE_BIN=$(command -v true)
+BENCH_DIR=$(mktemp -d)
+SCRIPT=$BENCH_DIR/spawn_rate.qsh
+
+trap 'rm -rf $BENCH_DIR' EXIT
+
+# One launch per line
+for ((i = 0; i < COUNT; ++i)); do
+    echo "$TRUE_BIN"
+done > $SCRIPT
+
+printf "%-8s %10s %14s\n" "BACKEND" "SECONDS" "LAUNCHES/SEC"
+
+for backend in fork vfork spawn zygote; do
+    start=$(date +%s%N)
+    QUASH_SPAWN=$backend ./quash < $SCRIPT > /dev/null
+    end=$(date +%s%N)
+
+    awk -v b=$backend -v ns=$((end - start)) -v n=$COUNT \
+        'BEGIN { printf "%-8s %10.3f %14.0f\n", b, ns / 1e9, n / (ns / 1e9) }'
+done
@@ -0,0 +1,155 @@
+/**
+ * @file startup.c
+ *
+ * @brief Measures how long "quash -c" takes from being executed until the
+ * first program it launches is running
+ *
+ * The benchmark runs quash with a script whose first program is this binary
+ * in stamp mode. That program writes the monotonic clock to standard out the
+ * moment it starts. The same program is also launched directly to measure
+ * what exec costs on its own, so the difference is the time spent in quash.
+ *
+ * Usage: startup QUASH [RUNS]
+ */
+
+#define _GNU_SOURCE
+
+#include <spawn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Time budget for quash's own share of the startup in nanoseconds
+#define BUDGET_NS 1000000
+
+extern char** environ;
+
+// Read the monotonic clock in nanoseconds
+static uint64_t now_ns() {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Launch argv with standard out connected to a pipe and return the time
+// between launching it and the stamp arriving
+static uint64_t time_to_stamp(char** argv) {
+  int fds[2];
+  posix_spawn_file_actions_t actions;
+  uint64_t stamp = 0;
+  pid_t pid;
+
+  if (pipe(fds) < 0) {
+    perror("pipe");
+    exit(1);
+  }
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+  posix_spawn_file_actions_addclose(&actions, fds[0]);
+
+  uint64_t start = now_ns();
+
+  if (posix_spawn(&pid, argv[0], &actions, NULL, argv, environ) != 0) {
+    perror("posix_spawn");
+    exit(1);
+  }
+
+  close(fds[1]);
+
+  if (read(fds[0], &stamp, sizeof(stamp)) != sizeof(stamp)) {
+    fprintf(stderr, "%s did not start the stamp program\n", argv[0]);
+    exit(1);
+  }
+
+  close(fds[0]);
+  waitpid(pid, NULL, 0);
+  posix_spawn_file_actions_destroy(&actions);
+
+  return stamp - start;
+}
+
+static int compare(const void* a, const void* b) {
+  uint64_t x = *(const uint64_t*) a;
+  uint64_t y = *(const uint64_t*) b;
+
+  return (x > y) - (x < y);
+}
+
+// Time RUNS launches of argv and return the median after printing a summary
+static uint64_t report(const char* name, char** argv, int runs) {
+  uint64_t* samples = malloc(runs * sizeof(uint64_t));
+
+  for (int i = 0; i < runs; ++i)
+    samples[i] = time_to_stamp(argv);
+
+  qsort(samples, runs, sizeof(uint64_t), compare);
+
+  uint64_t median = samples[runs / 2];
+
+  printf("%-8s %10.1f %10.1f %10.1f\n", name, median / 1e3,
+         samples[runs * 9 / 10] / 1e3, samples[runs * 99 / 100] / 1e3);
+
+  free(samples);
+
+  return median;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1 && strcmp(argv[1], "--stamp") == 0) {
+    uint64_t stamp = now_ns();
+
+    return write(STDOUT_FILENO, &stamp, sizeof(stamp)) != sizeof(stamp);
+  }
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s QUASH [RUNS]\n", argv[0]);
+    return 1;
+  }
+
+  char* self = realpath("/proc/self/exe", NULL);
+  char* quash = realpath(argv[1], NULL);
+  int runs = (argc > 2) ? atoi(argv[2]) : 1000;
+
+  if (self == NULL || quash == NULL || runs <= 0) {
+    fprintf(stderr, "Usage: %s QUASH [RUNS]\n", argv[0]);
+    return 1;
+  }
+
+  // The stamp program as the only command is exec'd in place of quash. Given
+  // another command to run afterwards quash has to create a process for it.
+  char exec_script[strlen(self) + 16];
+  char spawn_script[strlen(self) + 32];
+
+  sprintf(exec_script, "%s --stamp", self);
+  sprintf(spawn_script, "%s --stamp\n/bin/true", self);
+
+  char* direct_argv[] = { self, "--stamp", NULL };
+  char* exec_argv[] = { quash, "-c", exec_script, NULL };
+  char* spawn_argv[] = { quash, "-c", spawn_script, NULL };
+
+  printf("Microseconds from exec to the first program running, %d runs\n",
+         runs);
+  printf("%-8s %10s %10s %10s\n", "MODE", "MEDIAN", "P90", "P99");
+
+  uint64_t direct = report("direct", direct_argv, runs);
+  uint64_t exec = report("exec", exec_argv, runs);
+  uint64_t spawn = report("spawn", spawn_argv, runs);
+
+  // Direct launches show what the exec itself costs. The rest is quash.
+  int64_t worst = (int64_t) ((exec > spawn) ? exec : spawn) - (int64_t) direct;
+
+  printf("quash overhead %.1f us, budget %.1f us: %s\n", worst / 1e3,
+         BUDGET_NS / 1e3, (worst < BUDGET_NS) ? "ok" : "OVER BUDGET");
+
+  free(self);
+  free(quash);
+
+  return 0;
+}
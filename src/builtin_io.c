@@ -0,0 +1,360 @@
+/**
+ * @file builtin_io.c
+ *
+ * @brief Implements the input and output functions used by builtin commands
+ */
+
+#include "builtin_io.h"
+
+#include <errno.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @brief Where builtin output of a thread goes
+ */
+typedef enum SinkType {
+  SINK_STDOUT = 0, /**< Standard out through stdio */
+  SINK_BUFFER,     /**< An @a OutBuffer */
+  SINK_FD,         /**< A file descriptor */
+  SINK_RING        /**< A @a Ring */
+} SinkType;
+
+/**
+ * @brief Where builtin input of a thread comes from
+ */
+typedef enum SourceType {
+  SOURCE_STDIN = 0, /**< Standard in */
+  SOURCE_FD,        /**< A file descriptor */
+  SOURCE_RING       /**< A @a Ring */
+} SourceType;
+
+struct Ring {
+  char* data;                 // Storage, cap bytes long
+  size_t mask;                // cap - 1
+  _Atomic size_t head;        // Total bytes written. Only the writer stores it.
+  _Atomic size_t tail;        // Total bytes read. Only the reader stores it.
+  _Atomic bool writer_closed; // Set once the writer is done
+  _Atomic bool reader_closed; // Set once the reader is gone
+};
+
+static _Thread_local SinkType sink_type = SINK_STDOUT;
+static _Thread_local OutBuffer* sink_buffer = NULL;
+static _Thread_local int sink_fd = -1;
+static _Thread_local bool sink_fd_closed = false;
+static _Thread_local Ring* sink_ring = NULL;
+
+static _Thread_local SourceType source_type = SOURCE_STDIN;
+static _Thread_local int source_fd = -1;
+static _Thread_local Ring* source_ring = NULL;
+
+/***************************************************************************
+ * Buffers and rings
+ ***************************************************************************/
+// Make room for at least `extra` more bytes
+static void __reserve(OutBuffer* buf, size_t extra) {
+  if (buf->len + extra <= buf->cap)
+    return;
+
+  size_t cap = (buf->cap == 0) ? 256 : buf->cap;
+
+  while (cap < buf->len + extra)
+    cap *= 2;
+
+  char* data = realloc(buf->data, cap);
+
+  if (data == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate builtin output buffer\n");
+    exit(-1);
+  }
+
+  buf->data = data;
+  buf->cap = cap;
+}
+
+OutBuffer new_out_buffer() {
+  return (OutBuffer) {
+    NULL,
+    0,
+    0
+  };
+}
+
+void destroy_out_buffer(OutBuffer* buf) {
+  free(buf->data);
+  *buf = new_out_buffer();
+}
+
+// Back off while the other side of a ring catches up. Spin briefly, then give
+// the CPU away so a stalled partner does not cost a whole core.
+static void __ring_wait(unsigned* spins) {
+  if (++(*spins) < 64) {
+    sched_yield();
+  }
+  else {
+    struct timespec pause = { 0, 50000 };
+    nanosleep(&pause, NULL);
+  }
+}
+
+Ring* new_ring(size_t cap) {
+  size_t size = 1;
+  Ring* ring = malloc(sizeof(Ring));
+
+  while (size < cap)
+    size <<= 1;
+
+  if (ring == NULL || (ring->data = malloc(size)) == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate ring buffer\n");
+    exit(-1);
+  }
+
+  ring->mask = size - 1;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  atomic_init(&ring->writer_closed, false);
+  atomic_init(&ring->reader_closed, false);
+
+  return ring;
+}
+
+void destroy_ring(Ring* ring) {
+  if (ring == NULL)
+    return;
+
+  free(ring->data);
+  free(ring);
+}
+
+// Copy in as much as fits and wait for the reader to make room for the rest
+void ring_write(Ring* ring, const void* data, size_t len) {
+  const char* src = data;
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  unsigned spins = 0;
+
+  while (len > 0) {
+    if (atomic_load_explicit(&ring->reader_closed, memory_order_acquire))
+      return;
+
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t space = ring->mask + 1 - (head - tail);
+
+    if (space == 0) {
+      __ring_wait(&spins);
+      continue;
+    }
+
+    size_t n = (len < space) ? len : space;
+    size_t off = head & ring->mask;
+    size_t first = ring->mask + 1 - off;
+
+    if (first > n)
+      first = n;
+
+    memcpy(ring->data + off, src, first);
+    memcpy(ring->data, src + first, n - first);
+
+    head += n;
+    src += n;
+    len -= n;
+    spins = 0;
+
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+  }
+}
+
+// Copy out whatever is available, waiting only while the ring is empty
+size_t ring_read(Ring* ring, void* data, size_t len) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  unsigned spins = 0;
+
+  while (true) {
+    size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t avail = head - tail;
+
+    if (avail == 0) {
+      if (atomic_load_explicit(&ring->writer_closed, memory_order_acquire)
+          && atomic_load_explicit(&ring->head, memory_order_acquire) == tail)
+        return 0;
+
+      __ring_wait(&spins);
+      continue;
+    }
+
+    size_t n = (len < avail) ? len : avail;
+    size_t off = tail & ring->mask;
+    size_t first = ring->mask + 1 - off;
+
+    if (first > n)
+      first = n;
+
+    memcpy(data, ring->data + off, first);
+    memcpy((char*) data + first, ring->data, n - first);
+
+    atomic_store_explicit(&ring->tail, tail + n, memory_order_release);
+
+    return n;
+  }
+}
+
+void ring_close_writer(Ring* ring) {
+  atomic_store_explicit(&ring->writer_closed, true, memory_order_release);
+}
+
+void ring_close_reader(Ring* ring) {
+  atomic_store_explicit(&ring->reader_closed, true, memory_order_release);
+}
+
+/***************************************************************************
+ * Builtin input and output
+ ***************************************************************************/
+// Deliver bytes to the current thread's sink
+static void __emit(const char* data, size_t len) {
+  switch (sink_type) {
+  case SINK_STDOUT:
+    fwrite(data, 1, len, stdout);
+    break;
+
+  case SINK_BUFFER:
+    __reserve(sink_buffer, len);
+    memcpy(sink_buffer->data + sink_buffer->len, data, len);
+    sink_buffer->len += len;
+    break;
+
+  case SINK_FD:
+    while (len > 0) {
+      ssize_t n = write(sink_fd, data, len);
+
+      if (n < 0) {
+        if (errno == EINTR)
+          continue;
+
+        // The reader is gone. Drop the output like a killed process would.
+        sink_fd_closed = true;
+        break;
+      }
+
+      data += n;
+      len -= n;
+    }
+    break;
+
+  case SINK_RING:
+    ring_write(sink_ring, data, len);
+    break;
+  }
+}
+
+// Format onto the current thread's sink
+void builtin_printf(const char* fmt, ...) {
+  va_list args;
+
+  va_start(args, fmt);
+
+  if (sink_type == SINK_STDOUT) {
+    vprintf(fmt, args);
+  }
+  else {
+    char small[256];
+    va_list copy;
+    int len;
+
+    va_copy(copy, args);
+    len = vsnprintf(small, sizeof(small), fmt, copy);
+    va_end(copy);
+
+    if (len >= (int) sizeof(small)) {
+      char* large = malloc(len + 1);
+
+      if (large != NULL) {
+        vsnprintf(large, len + 1, fmt, args);
+        __emit(large, len);
+        free(large);
+      }
+    }
+    else if (len > 0) {
+      __emit(small, len);
+    }
+  }
+
+  va_end(args);
+}
+
+void builtin_write(const void* data, size_t len) {
+  __emit(data, len);
+}
+
+// Only stdio keeps anything back. Every other sink is written immediately.
+void builtin_flush() {
+  if (sink_type == SINK_STDOUT)
+    fflush(stdout);
+}
+
+bool builtin_output_closed() {
+  switch (sink_type) {
+  case SINK_FD:
+    return sink_fd_closed;
+
+  case SINK_RING:
+    return atomic_load_explicit(&sink_ring->reader_closed,
+                                memory_order_acquire);
+
+  // A child writing to standard out gets SIGPIPE instead
+  case SINK_STDOUT:
+  case SINK_BUFFER:
+  default:
+    return false;
+  }
+}
+
+ssize_t builtin_read(void* data, size_t len) {
+  switch (source_type) {
+  case SOURCE_RING:
+    return ring_read(source_ring, data, len);
+
+  case SOURCE_FD:
+    return read(source_fd, data, len);
+
+  case SOURCE_STDIN:
+  default:
+    return read(STDIN_FILENO, data, len);
+  }
+}
+
+void begin_builtin_capture(OutBuffer* buf) {
+  sink_type = SINK_BUFFER;
+  sink_buffer = buf;
+}
+
+void end_builtin_capture() {
+  sink_type = SINK_STDOUT;
+  sink_buffer = NULL;
+}
+
+void builtin_output_to_fd(int fd) {
+  sink_type = SINK_FD;
+  sink_fd = fd;
+  sink_fd_closed = false;
+}
+
+void builtin_output_to_ring(Ring* ring) {
+  sink_type = SINK_RING;
+  sink_ring = ring;
+}
+
+void builtin_input_from_fd(int fd) {
+  source_type = SOURCE_FD;
+  source_fd = fd;
+}
+
+void builtin_input_from_ring(Ring* ring) {
+  source_type = SOURCE_RING;
+  source_ring = ring;
+}
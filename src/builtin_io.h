@@ -0,0 +1,202 @@
+/**
+ * @file builtin_io.h
+ *
+ * @brief Input and output functions for builtin commands
+ *
+ * Builtins read and write through these functions instead of stdio so quash
+ * can decide where their data goes. Normally output is written to standard
+ * out, but it can also be captured in memory, written to a file descriptor or
+ * passed to another builtin through a @a Ring. The destination is kept per
+ * thread so several builtins can run at the same time in different threads.
+ */
+
+#ifndef SRC_BUILTIN_IO_H
+#define SRC_BUILTIN_IO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/**
+ * @brief A growable block of memory holding captured builtin output
+ *
+ * @sa begin_builtin_capture()
+ */
+typedef struct OutBuffer {
+  char* data; /**< Captured bytes. This is not NUL terminated. */
+  size_t len; /**< Number of bytes in @a data */
+  size_t cap; /**< Number of bytes allocated for @a data */
+} OutBuffer;
+
+/**
+ * @brief A lock-free single producer, single consumer byte ring connecting two
+ * builtins running in different threads
+ *
+ * @sa new_ring(), ring_write(), ring_read()
+ */
+typedef struct Ring Ring;
+
+/**
+ * @brief Create an empty @a OutBuffer
+ *
+ * @return An OutBuffer that does not hold any memory yet
+ */
+OutBuffer new_out_buffer();
+
+/**
+ * @brief Free the memory held by an @a OutBuffer
+ *
+ * @param buf The buffer to free
+ */
+void destroy_out_buffer(OutBuffer* buf);
+
+/**
+ * @brief Allocate a @a Ring
+ *
+ * @param cap Number of bytes the ring can hold. This is rounded up to a power
+ * of two.
+ *
+ * @return A new, open Ring
+ */
+Ring* new_ring(size_t cap);
+
+/**
+ * @brief Free a @a Ring once neither side uses it anymore
+ *
+ * @param ring The ring to free
+ */
+void destroy_ring(Ring* ring);
+
+/**
+ * @brief Copy bytes into a @a Ring, waiting while it is full
+ *
+ * Data written after the reading side has been closed is discarded, just like
+ * a process writing to a pipe nobody reads anymore.
+ *
+ * @param ring The ring to write to
+ *
+ * @param data Bytes to write
+ *
+ * @param len Number of bytes in @a data
+ */
+void ring_write(Ring* ring, const void* data, size_t len);
+
+/**
+ * @brief Copy bytes out of a @a Ring, waiting while it is empty
+ *
+ * @param ring The ring to read from
+ *
+ * @param data Buffer to fill
+ *
+ * @param len Size of @a data
+ *
+ * @return Number of bytes read or 0 once the writing side is closed and
+ * everything has been read
+ */
+size_t ring_read(Ring* ring, void* data, size_t len);
+
+/**
+ * @brief Mark that no more data will be written to a @a Ring
+ *
+ * @param ring The ring to close
+ */
+void ring_close_writer(Ring* ring);
+
+/**
+ * @brief Mark that no more data will be read from a @a Ring
+ *
+ * @param ring The ring to close
+ */
+void ring_close_reader(Ring* ring);
+
+/**
+ * @brief Write formatted builtin output
+ *
+ * @param fmt A printf() style format string
+ *
+ * @param ... Arguments to be substituted into the format string
+ */
+void builtin_printf(const char* fmt, ...)
+  __attribute__ ((format (printf, 1, 2)));
+
+/**
+ * @brief Write raw bytes of builtin output
+ *
+ * @param data Bytes to write
+ *
+ * @param len Number of bytes in @a data
+ */
+void builtin_write(const void* data, size_t len);
+
+/**
+ * @brief Push written output to its destination
+ */
+void builtin_flush();
+
+/**
+ * @brief Check whether nobody reads builtin output of this thread anymore
+ *
+ * A builtin that writes a lot can stop early once this is true, like a
+ * process would be stopped by SIGPIPE.
+ *
+ * @return True if a write to the pipe failed or the reader of the ring left
+ */
+bool builtin_output_closed();
+
+/**
+ * @brief Read builtin input from the current thread's input source
+ *
+ * @param data Buffer to fill
+ *
+ * @param len Size of @a data
+ *
+ * @return Number of bytes read, 0 at end of input or -1 on error
+ */
+ssize_t builtin_read(void* data, size_t len);
+
+/**
+ * @brief Send all following builtin output of this thread to @a buf instead of
+ * standard out
+ *
+ * @param buf The buffer to append output to
+ *
+ * @sa end_builtin_capture()
+ */
+void begin_builtin_capture(OutBuffer* buf);
+
+/**
+ * @brief Send builtin output of this thread to standard out again
+ *
+ * @sa begin_builtin_capture()
+ */
+void end_builtin_capture();
+
+/**
+ * @brief Send builtin output of this thread to a file descriptor
+ *
+ * @param fd Descriptor to write to
+ */
+void builtin_output_to_fd(int fd);
+
+/**
+ * @brief Send builtin output of this thread into a @a Ring
+ *
+ * @param ring Ring to write to
+ */
+void builtin_output_to_ring(Ring* ring);
+
+/**
+ * @brief Read builtin input of this thread from a file descriptor
+ *
+ * @param fd Descriptor to read from
+ */
+void builtin_input_from_fd(int fd);
+
+/**
+ * @brief Read builtin input of this thread from a @a Ring
+ *
+ * @param ring Ring to read from
+ */
+void builtin_input_from_ring(Ring* ring);
+
+#endif
@@ -99,11 +99,12 @@ Command mk_pwd_command() {
 }
 
 // Create JobCommand structure
-Command mk_jobs_command() {
+Command mk_jobs_command(char** args) {
   Command cmd;
 
   cmd.jobs = (JobsCommand) {
-    JOBS
+    JOBS,
+    args
   };
 
   return cmd;
@@ -140,6 +141,140 @@ CommandType get_command_holder_type(CommandHolder holder) {
   return get_command_type(holder.cmd);
 }
 
+/**
+ * @brief Where copy_script() puts the next argument array and string
+ *
+ * With NULL cursors nothing is written and only the space needed is counted.
+ */
+typedef struct ScriptCopy {
+  char** ptrs;     /**< Next free entry for argument arrays */
+  char* strs;      /**< Next free byte for string contents */
+  size_t num_ptrs; /**< Argument array entries used so far */
+  size_t len;      /**< String bytes used so far */
+} ScriptCopy;
+
+// Copy a string to the block, counting its size either way
+static char* __copy_string(ScriptCopy* copy, const char* str) {
+  if (str == NULL)
+    return NULL;
+
+  size_t len = strlen(str) + 1;
+  char* dst = copy->strs;
+
+  copy->len += len;
+
+  if (dst == NULL)
+    return NULL;
+
+  copy->strs += len;
+
+  return memcpy(dst, str, len);
+}
+
+// Copy a NULL terminated argument array and its strings to the block
+static char** __copy_args(ScriptCopy* copy, char** args) {
+  size_t n = 0;
+
+  if (args == NULL)
+    return NULL;
+
+  while (args[n] != NULL)
+    ++n;
+
+  char** dst = copy->ptrs;
+
+  copy->num_ptrs += n + 1;
+
+  if (dst != NULL)
+    copy->ptrs += n + 1;
+
+  for (size_t i = 0; i < n; ++i) {
+    char* str = __copy_string(copy, args[i]);
+
+    if (dst != NULL)
+      dst[i] = str;
+  }
+
+  if (dst != NULL)
+    dst[n] = NULL;
+
+  return dst;
+}
+
+// Copy a holder and everything it points to
+static void __copy_holder(ScriptCopy* copy, CommandHolder* dst,
+                          const CommandHolder* src) {
+  *dst = *src;
+  dst->redirect_in = __copy_string(copy, src->redirect_in);
+  dst->redirect_out = __copy_string(copy, src->redirect_out);
+
+  switch (get_command_holder_type(*src)) {
+  case GENERIC:
+  case ECHO:
+  case JOBS:
+  case HASH:
+  case EXEC:
+  case FG:
+  case BG:
+  case AFTER:
+  case WAIT:
+  case TIMEOUT:
+  case BUDGET:
+  case JOBLOG:
+  case TIME:
+  case BENCH:
+  case UTILITY:
+    dst->cmd.generic.args = __copy_args(copy, src->cmd.generic.args);
+    break;
+
+  case EXPORT:
+    dst->cmd.export.env_var = __copy_string(copy, src->cmd.export.env_var);
+    dst->cmd.export.val = __copy_string(copy, src->cmd.export.val);
+    break;
+
+  case CD:
+    dst->cmd.cd.dir = __copy_string(copy, src->cmd.cd.dir);
+    break;
+
+  case KILL:
+    dst->cmd.kill.sig_str = __copy_string(copy, src->cmd.kill.sig_str);
+    dst->cmd.kill.job_str = __copy_string(copy, src->cmd.kill.job_str);
+    break;
+
+  default:
+    break;
+  }
+}
+
+// Measure the script first, then copy it into a block of exactly that size
+CommandHolder* copy_script(const CommandHolder* holders) {
+  ScriptCopy copy = { NULL, NULL, 0, 0 };
+  CommandHolder scratch;
+  size_t n = 0;
+
+  while (get_command_holder_type(holders[n]) != EOC)
+    __copy_holder(&copy, &scratch, &holders[n++]);
+
+  size_t holder_size = (n + 1) * sizeof(CommandHolder);
+  size_t ptr_size = copy.num_ptrs * sizeof(char*);
+  CommandHolder* block = malloc(holder_size + ptr_size + copy.len);
+
+  if (block == NULL)
+    return NULL;
+
+  copy = (ScriptCopy) {
+    (char**) ((char*) block + holder_size),
+    (char*) block + holder_size + ptr_size,
+    0,
+    0
+  };
+
+  for (size_t i = 0; i <= n; ++i)
+    __copy_holder(&copy, &block[i], &holders[i]);
+
+  return block;
+}
+
 #ifdef DEBUG
 static void __print_generic_cmd(GenericCommand cmd) {
   if (cmd.args != NULL) {
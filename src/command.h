@@ -69,7 +69,19 @@ typedef enum CommandType {
   CD,
   PWD,
   JOBS,
-  EXIT
+  EXIT,
+  HASH,
+  EXEC,
+  FG,
+  BG,
+  AFTER,
+  WAIT,
+  TIMEOUT,
+  BUDGET,
+  JOBLOG,
+  TIME,
+  BENCH,
+  UTILITY
 } CommandType;
 
 // Command Structures
@@ -154,11 +166,160 @@ typedef struct KillCommand {
 typedef SimpleCommand PWDCommand;
 
 /**
- * @brief Alias for @a SimpleCommand to denote a print jobs list
+ * @brief Alias for @a GenericCommand to denote a print jobs list
  *
- * @sa SimpleCommand, Command, Job
+ * The arguments are "jobs" and optionally "-v" to list the processes of each
+ * job as well.
+ *
+ * @sa GenericCommand, Command, Job
  */
-typedef SimpleCommand JobsCommand;
+typedef GenericCommand JobsCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command to list, seed or clear
+ * the program location cache
+ *
+ * @note The parser produces a @a GenericCommand for this. It is recognized by
+ * name before the command is run.
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand HashCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that replaces quash
+ * with another program
+ *
+ * @note The parser produces a @a GenericCommand for this. It is recognized by
+ * name before the command is run. The program to run starts at args[1].
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand ExecCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that brings a job to
+ * the foreground
+ *
+ * @note The parser produces a @a GenericCommand for this. It is recognized by
+ * name before the command is run. args[1] names the job as "%N" or "N" and
+ * defaults to the most recent job.
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand FGCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that continues a
+ * stopped job in the background
+ *
+ * @note The parser produces a @a GenericCommand for this. It is recognized by
+ * name before the command is run. args[1] names the job like for @a
+ * FGCommand.
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand BGCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that starts the rest
+ * of its command line once other jobs have finished
+ *
+ * @note The parser produces a @a GenericCommand for this. It is recognized by
+ * name before the command is run. The arguments are an optional "-s", the
+ * jobs to wait for as "%N", an optional "--" and then the program to run.
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand AfterCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that waits for
+ * background jobs
+ *
+ * @note The parser produces a @a GenericCommand for this. It is recognized by
+ * name before the command is run. The arguments are "-n", or jobs as "%N" or
+ * by the pid of one of their processes. Without arguments every job is waited
+ * for.
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand WaitCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that runs the rest
+ * of its command line with a time limit
+ *
+ * @note The parser produces a @a GenericCommand for this. It is recognized by
+ * name before the command is run. The arguments are the duration, optionally
+ * "-k" and a second duration before or after it, an optional "--" and then
+ * the program to run.
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand TimeoutCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that limits the CPU
+ * time and memory of a job
+ *
+ * @note The parser produces a @a GenericCommand for this. It is recognized by
+ * name before the command is run. The arguments are "-c" with a CPU time,
+ * "-m" with a memory size and "-k", in any order, followed by either a job as
+ * "%N" or an optional "--" and the program to run.
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand BudgetCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that prints the
+ * output a background job left in its log
+ *
+ * @note The parser produces a @a GenericCommand for this. It is recognized by
+ * name before the command is run. The arguments are a job as "%N" and
+ * optionally "-f", in any order.
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand JoblogCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that runs the rest
+ * of its command line and reports the resources it used
+ *
+ * @note The parser produces a @a GenericCommand for this. It is recognized by
+ * name before the command is run. The arguments are an optional "--" and
+ * then the program to run.
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand TimeCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote a command that runs the rest
+ * of its command line many times and reports statistics of how long it took
+ *
+ * @note The parser produces a @a GenericCommand for this. It is recognized by
+ * name before the command is run. The arguments are "-n" with a number of
+ * runs, "-w" with a number of warmup runs and "-j", in any order, an optional
+ * "--" and then the program to run.
+ *
+ * @sa GenericCommand, Command
+ */
+typedef GenericCommand BenchCommand;
+
+/**
+ * @brief Alias for @a GenericCommand to denote one of the small programs
+ * quash carries itself, such as true, test or seq
+ *
+ * @note The parser produces a @a GenericCommand for this. It is recognized by
+ * name before the command is run. The arguments are the same as the program
+ * of that name takes, including the name itself.
+ *
+ * @sa GenericCommand, Command, run_utility()
+ */
+typedef GenericCommand UtilityCommand;
 
 /**
  * @brief Alias for @a SimpleCommand to denote a termination of the program
@@ -183,7 +344,9 @@ typedef SimpleCommand EOCCommand;
  *
  * @sa get_command_type, SimpleCommand, GenericCommand, EchoCommand,
  * ExportCommand, CDCommand, KillCommand, PWDCommand, JobsCommand, ExitCommand,
- * EOCCommand
+ * HashCommand, ExecCommand, FGCommand, BGCommand, AfterCommand, WaitCommand,
+ * TimeoutCommand, BudgetCommand, JoblogCommand, TimeCommand, BenchCommand,
+ * UtilityCommand, EOCCommand
  */
 typedef union Command {
   SimpleCommand simple;   /**< Read structure as a @a SimpleCommand */
@@ -195,6 +358,18 @@ typedef union Command {
   PWDCommand pwd;         /**< Read structure as a @a PWDCommand */
   JobsCommand jobs;       /**< Read structure as a @a JobsCommand */
   ExitCommand exit;       /**< Read structure as a @a ExitCommand */
+  HashCommand hash;       /**< Read structure as a @a HashCommand */
+  ExecCommand exec;       /**< Read structure as a @a ExecCommand */
+  FGCommand fg;           /**< Read structure as a @a FGCommand */
+  BGCommand bg;           /**< Read structure as a @a BGCommand */
+  AfterCommand after;     /**< Read structure as a @a AfterCommand */
+  WaitCommand wait;       /**< Read structure as a @a WaitCommand */
+  TimeoutCommand timeout; /**< Read structure as a @a TimeoutCommand */
+  BudgetCommand budget;   /**< Read structure as a @a BudgetCommand */
+  JoblogCommand joblog;   /**< Read structure as a @a JoblogCommand */
+  TimeCommand time;       /**< Read structure as a @a TimeCommand */
+  BenchCommand bench;     /**< Read structure as a @a BenchCommand */
+  UtilityCommand utility; /**< Read structure as a @a UtilityCommand */
   EOCCommand eoc;         /**< Read structure as a @a EOCCommand */
 } Command;
 
@@ -323,11 +498,13 @@ Command mk_pwd_command();
 /**
  * @brief Create a @a JobsCommand structure and return a copy
  *
+ * @param args Null terminated list of strings starting with "jobs"
+ *
  * @return Copy of constructed JobsCommand
  *
  * @sa Command, JobsCommand
  */
-Command mk_jobs_command();
+Command mk_jobs_command(char** args);
 
 /**
  * @brief Create a @a ExitCommand structure and return a copy
@@ -376,6 +553,21 @@ CommandType get_command_type(Command cmd);
  */
 CommandType get_command_holder_type(CommandHolder holder);
 
+/**
+ * @brief Copy a script out of the parser's memory pool
+ *
+ * The holders, their argument arrays and every string are placed in one
+ * malloc'd block, so the copy outlives the pool and a single free() releases
+ * it.
+ *
+ * @param holders @a CommandHolder array terminated by an @a EOC command
+ *
+ * @return The copy or NULL if it could not be allocated
+ *
+ * @sa CommandHolder
+ */
+CommandHolder* copy_script(const CommandHolder* holders);
+
 /**
  * @brief Print all commands in the script with @a print_command()
  *
@@ -0,0 +1,397 @@
+/**
+ * @file event_loop.c
+ *
+ * @brief Implements the epoll loop quash waits in between commands
+ */
+
+#include "event_loop.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+// Tags stored in the epoll events so we know which fd woke us up. A watched
+// descriptor is tagged with its number after TAG_FIRST_FD.
+#define TAG_INPUT 0
+#define TAG_CHILD 1
+#define TAG_TIMER 2
+#define TAG_EVENTS 3
+#define TAG_FIRST_FD 4
+
+/**
+ * @brief A descriptor added with watch_fd()
+ */
+typedef struct Watch {
+  FdHandler handler; /**< Called when the descriptor is readable. NULL if the
+                      * slot is free. */
+  void* data;        /**< Passed along to @a handler */
+} Watch;
+
+// Signals that would stop quash. They are ignored while the loop runs.
+static const int job_signals[] = { SIGTSTP, SIGTTIN, SIGTTOU };
+
+#define NUM_JOB_SIGNALS (sizeof(job_signals) / sizeof(job_signals[0]))
+
+// The outer set watches standard in and the inner set. The inner set holds
+// everything else, so waiting for a child is a single epoll_wait() on it.
+static int epoll_fd = -1;
+static int events_fd = -1;
+static int signal_fd = -1;
+static int timer_fd = -1;
+static bool timer_armed = false;
+static bool watching = false;
+static bool running = false;
+static sigset_t original_mask;
+static sigset_t default_signals;
+static struct sigaction original_actions[NUM_JOB_SIGNALS];
+
+// Watched descriptors, indexed by their number
+static Watch* watches = NULL;
+static size_t num_watch_slots = 0;
+static size_t num_watches = 0;
+
+// Set when wait_for_event() consumed a SIGCHLD that take_child_events() has
+// not reported yet
+static bool child_pending = false;
+
+// Add fd to an epoll set for reading
+static bool __watch(int set, int fd, uint32_t tag) {
+  struct epoll_event ev = { 0 };
+
+  ev.events = EPOLLIN;
+  ev.data.u32 = tag;
+
+  return epoll_ctl(set, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+// Read every queued SIGCHLD. The kernel merges them so this is usually one.
+// Returns true if there was any.
+static bool __drain_signals() {
+  struct signalfd_siginfo info[16];
+  bool any = false;
+
+  while (read(signal_fd, info, sizeof(info)) > 0)
+    any = true;
+
+  return any;
+}
+
+// Put SIGCHLD on the signalfd
+bool watch_child_signals() {
+  sigset_t chld;
+
+  if (watching)
+    return true;
+
+  sigemptyset(&chld);
+  sigaddset(&chld, SIGCHLD);
+
+  if (sigprocmask(SIG_BLOCK, &chld, &original_mask) < 0)
+    return false;
+
+  if ((signal_fd = signalfd(-1, &chld, SFD_CLOEXEC | SFD_NONBLOCK)) < 0) {
+    sigprocmask(SIG_SETMASK, &original_mask, NULL);
+    return false;
+  }
+
+  events_fd = epoll_create1(EPOLL_CLOEXEC);
+
+  if (events_fd < 0 || !__watch(events_fd, signal_fd, TAG_CHILD)
+      || (timer_fd >= 0 && !__watch(events_fd, timer_fd, TAG_TIMER))) {
+    if (events_fd >= 0)
+      close(events_fd);
+
+    close(signal_fd);
+    events_fd = signal_fd = -1;
+    sigprocmask(SIG_SETMASK, &original_mask, NULL);
+    return false;
+  }
+
+  watching = true;
+
+  return true;
+}
+
+bool take_child_events() {
+  // Without the signalfd every call has to assume something happened
+  if (!watching)
+    return true;
+
+  bool any = __drain_signals() || child_pending;
+
+  child_pending = false;
+
+  return any;
+}
+
+bool set_event_timer(const struct timespec* deadline) {
+  struct itimerspec spec = { { 0, 0 }, { 0, 0 } };
+
+  // Nothing to disarm. This keeps quash without time limits off the timerfd.
+  if (deadline == NULL && !timer_armed)
+    return true;
+
+  if (timer_fd < 0) {
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+
+    if (timer_fd < 0)
+      return false;
+
+    if (watching && !__watch(events_fd, timer_fd, TAG_TIMER)) {
+      close(timer_fd);
+      timer_fd = -1;
+      return false;
+    }
+  }
+
+  if (deadline != NULL)
+    spec.it_value = *deadline;
+
+  // A zero deadline would disarm the timer, so one that already passed is
+  // moved up to the smallest time that still fires
+  if (deadline != NULL && spec.it_value.tv_sec == 0
+      && spec.it_value.tv_nsec == 0)
+    spec.it_value.tv_nsec = 1;
+
+  if (timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) < 0)
+    return false;
+
+  timer_armed = deadline != NULL;
+
+  return true;
+}
+
+bool take_timer_events() {
+  uint64_t expirations = 0;
+
+  if (timer_fd < 0)
+    return false;
+
+  return read(timer_fd, &expirations, sizeof(expirations)) > 0
+         && expirations > 0;
+}
+
+bool start_event_loop() {
+  struct sigaction ignore = { 0 };
+
+  if (running)
+    return true;
+
+  if (!watch_child_signals())
+    return false;
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+
+  if (epoll_fd < 0 || !__watch(epoll_fd, STDIN_FILENO, TAG_INPUT)
+      || !__watch(epoll_fd, events_fd, TAG_EVENTS)) {
+    perror("ERROR: Failed to start event loop");
+
+    if (epoll_fd >= 0)
+      close(epoll_fd);
+
+    epoll_fd = -1;
+    return false;
+  }
+
+  ignore.sa_handler = SIG_IGN;
+  sigemptyset(&default_signals);
+
+  for (size_t i = 0; i < NUM_JOB_SIGNALS; ++i) {
+    sigaction(job_signals[i], &ignore, &original_actions[i]);
+
+    if (original_actions[i].sa_handler == SIG_DFL)
+      sigaddset(&default_signals, job_signals[i]);
+  }
+
+  running = true;
+
+  return true;
+}
+
+// Handle what is ready in the inner set, waiting up to timeout milliseconds
+// for something to be. Handlers of watched descriptors run right here.
+static Event __dispatch(int timeout) {
+  struct epoll_event evs[16];
+  bool child = false;
+  bool timer = false;
+  int n;
+
+  while ((n = epoll_wait(events_fd, evs, 16, timeout)) < 0) {
+    if (errno != EINTR)
+      return EVENT_CHILD;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    uint32_t tag = evs[i].data.u32;
+
+    if (tag == TAG_CHILD) {
+      child = true;
+    }
+    else if (tag == TAG_TIMER) {
+      timer = true;
+    }
+    else {
+      // A handler earlier in this batch may have unwatched it already
+      Watch* watch = &watches[tag - TAG_FIRST_FD];
+
+      if (watch->handler != NULL)
+        watch->handler(tag - TAG_FIRST_FD, watch->data);
+    }
+  }
+
+  if (child) {
+    __drain_signals();
+    child_pending = true;
+    return EVENT_CHILD;
+  }
+
+  return timer ? EVENT_TIMER : EVENT_FD;
+}
+
+Event wait_for_event() {
+  struct epoll_event evs[2];
+  bool input = false;
+  bool inner = false;
+  int n;
+
+  if (!running)
+    return EVENT_INPUT;
+
+  while ((n = epoll_wait(epoll_fd, evs, 2, -1)) < 0) {
+    // Without a working epoll let the parser block on standard in as usual
+    if (errno != EINTR)
+      return EVENT_INPUT;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    if (evs[i].data.u32 == TAG_EVENTS)
+      inner = true;
+    else
+      input = true;
+  }
+
+  if (inner) {
+    Event event = __dispatch(0);
+
+    if (event != EVENT_FD)
+      return event;
+  }
+
+  return input ? EVENT_INPUT : EVENT_FD;
+}
+
+Event wait_for_child_event() {
+  if (!watching)
+    return EVENT_CHILD;
+
+  return __dispatch(-1);
+}
+
+bool watch_fd(int fd, FdHandler handler, void* data) {
+  if (!watching || fd < 0)
+    return false;
+
+  if ((size_t) fd >= num_watch_slots) {
+    size_t slots = (num_watch_slots == 0) ? 16 : num_watch_slots;
+
+    while (slots <= (size_t) fd)
+      slots *= 2;
+
+    Watch* grown = realloc(watches, slots * sizeof(Watch));
+
+    if (grown == NULL)
+      return false;
+
+    for (size_t i = num_watch_slots; i < slots; ++i)
+      grown[i] = (Watch) { NULL, NULL };
+
+    watches = grown;
+    num_watch_slots = slots;
+  }
+
+  if (watches[fd].handler != NULL
+      || !__watch(events_fd, fd, TAG_FIRST_FD + (uint32_t) fd))
+    return false;
+
+  watches[fd] = (Watch) { handler, data };
+  ++num_watches;
+
+  return true;
+}
+
+void unwatch_fd(int fd) {
+  if (fd < 0 || (size_t) fd >= num_watch_slots || watches[fd].handler == NULL)
+    return;
+
+  epoll_ctl(events_fd, EPOLL_CTL_DEL, fd, NULL);
+  watches[fd] = (Watch) { NULL, NULL };
+  --num_watches;
+}
+
+bool has_watched_fds() {
+  return num_watches > 0;
+}
+
+const sigset_t* child_signal_mask() {
+  return watching ? &original_mask : NULL;
+}
+
+const sigset_t* child_default_signals() {
+  return running ? &default_signals : NULL;
+}
+
+void reset_child_signals() {
+  if (running) {
+    for (size_t i = 0; i < NUM_JOB_SIGNALS; ++i)
+      sigaction(job_signals[i], &original_actions[i], NULL);
+  }
+
+  if (watching)
+    sigprocmask(SIG_SETMASK, &original_mask, NULL);
+}
+
+void restore_shell_signals() {
+  struct sigaction ignore = { 0 };
+  sigset_t chld;
+
+  if (running) {
+    ignore.sa_handler = SIG_IGN;
+
+    for (size_t i = 0; i < NUM_JOB_SIGNALS; ++i)
+      sigaction(job_signals[i], &ignore, NULL);
+  }
+
+  if (watching) {
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+  }
+}
+
+void stop_event_loop() {
+  reset_child_signals();
+
+  if (epoll_fd >= 0)
+    close(epoll_fd);
+
+  if (events_fd >= 0)
+    close(events_fd);
+
+  if (signal_fd >= 0)
+    close(signal_fd);
+
+  if (timer_fd >= 0)
+    close(timer_fd);
+
+  free(watches);
+  watches = NULL;
+  num_watch_slots = num_watches = 0;
+
+  epoll_fd = events_fd = signal_fd = timer_fd = -1;
+  running = watching = timer_armed = false;
+}
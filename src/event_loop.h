@@ -0,0 +1,204 @@
+/**
+ * @file event_loop.h
+ *
+ * @brief Lets an interactive quash sleep until either the user types a line
+ * or a child process changes state
+ *
+ * SIGCHLD is blocked in quash and delivered through a signalfd instead. The
+ * reaper only asks the kernel about children after a SIGCHLD arrived, since
+ * every wait4() call walks all children of quash. When quash is interactive
+ * both the signalfd and standard in are watched by a single epoll instance,
+ * so an idle shell sits in epoll_wait() without using any CPU and still hears
+ * about a finished background job the moment it exits.
+ *
+ * A single timerfd carries the earliest time limit set by the timeout builtin.
+ * It is watched along with the signalfd, both while idle at the prompt and
+ * while quash waits for a job, so a time limit is enforced without a helper
+ * process or polling.
+ *
+ * Other modules may add descriptors of their own with watch_fd(), such as the
+ * pipes that carry the output of background jobs. Their handlers run from
+ * within wait_for_event() and wait_for_child_event(). The signalfd, the
+ * timerfd and these descriptors share one epoll instance, which the loop
+ * watches next to standard in.
+ *
+ * The job control signals SIGTSTP, SIGTTIN and SIGTTOU are ignored while the
+ * loop runs so quash itself is never stopped and can hand the terminal to its
+ * jobs. Programs quash starts must not inherit any of this. Every launch path
+ * restores the mask and the actions quash was started with, see
+ * reset_child_signals().
+ */
+
+#ifndef SRC_EVENT_LOOP_H
+#define SRC_EVENT_LOOP_H
+
+#include <signal.h>
+#include <stdbool.h>
+#include <time.h>
+
+/**
+ * @brief What woke up wait_for_event()
+ */
+typedef enum Event {
+  EVENT_INPUT = 0, /**< Standard in is readable, closed or broken */
+  EVENT_CHILD,     /**< At least one SIGCHLD arrived */
+  EVENT_TIMER,     /**< The timer set by set_event_timer() expired */
+  EVENT_FD         /**< Only descriptors added with watch_fd() were handled */
+} Event;
+
+/**
+ * @brief Called when a descriptor added with watch_fd() is readable
+ *
+ * @param fd The descriptor
+ *
+ * @param data The pointer given to watch_fd()
+ */
+typedef void (*FdHandler)(int fd, void* data);
+
+/**
+ * @brief Block SIGCHLD and deliver it through a signalfd
+ *
+ * Must be called before any thread is created so every thread inherits the
+ * blocked SIGCHLD.
+ *
+ * @return True on success. Otherwise take_child_events() always reports an
+ * event.
+ */
+bool watch_child_signals();
+
+/**
+ * @brief Check whether any child changed state since the last call
+ *
+ * @return True if a SIGCHLD arrived, including one consumed by
+ * wait_for_event(), or if SIGCHLD is not being watched
+ */
+bool take_child_events();
+
+/**
+ * @brief Set when the timerfd expires next
+ *
+ * @param deadline An absolute time on CLOCK_MONOTONIC or NULL to disarm the
+ * timer
+ *
+ * @return True on success
+ */
+bool set_event_timer(const struct timespec* deadline);
+
+/**
+ * @brief Check whether the timer expired since the last call
+ *
+ * @return True if the timer set by set_event_timer() went off
+ */
+bool take_timer_events();
+
+/**
+ * @brief Ignore the job control signals and start watching standard in and
+ * the signalfd
+ *
+ * Calls watch_child_signals() if that has not happened yet.
+ *
+ * @return True if the loop is running. On failure quash keeps working but
+ * only notices finished jobs when a command is run.
+ */
+bool start_event_loop();
+
+/**
+ * @brief Sleep until there is input, a child has changed state or the timer
+ * expired
+ *
+ * Pending SIGCHLD notifications are drained before returning. A child event
+ * is reported ahead of the timer and the timer ahead of input so completions
+ * are printed before the next command runs. Handlers of watched descriptors
+ * that are ready run before returning.
+ *
+ * @return The event that ended the wait
+ */
+Event wait_for_event();
+
+/**
+ * @brief Sleep until a child has changed state, the timer expired or a
+ * watched descriptor was handled
+ *
+ * Works whether or not the loop is running. Standard in is not watched. The
+ * timer is left for take_timer_events() to consume.
+ *
+ * @return @a EVENT_CHILD, @a EVENT_TIMER or @a EVENT_FD. Without a signalfd
+ * there is nothing to sleep on and @a EVENT_CHILD is returned right away.
+ */
+Event wait_for_child_event();
+
+/**
+ * @brief Call a handler whenever a descriptor is readable
+ *
+ * The handler should read until the descriptor would block, since it is
+ * called again for as long as anything is left. It may unwatch and close the
+ * descriptor.
+ *
+ * @param fd The descriptor. It stays owned by the caller.
+ *
+ * @param handler Function to call
+ *
+ * @param data Passed to @a handler
+ *
+ * @return True on success. Fails if SIGCHLD is not watched, since then there
+ * is nothing quash sleeps on.
+ */
+bool watch_fd(int fd, FdHandler handler, void* data);
+
+/**
+ * @brief Stop calling the handler of a descriptor
+ *
+ * Must be called before the descriptor is closed.
+ *
+ * @param fd A descriptor passed to watch_fd()
+ */
+void unwatch_fd(int fd);
+
+/**
+ * @brief Check whether any descriptor is watched
+ *
+ * @return True if some descriptor added with watch_fd() is still watched
+ */
+bool has_watched_fds();
+
+/**
+ * @brief The signal mask programs should start with
+ *
+ * @return The mask quash had before watch_child_signals() or NULL if SIGCHLD
+ * is not being watched and nothing needs to be restored
+ */
+const sigset_t* child_signal_mask();
+
+/**
+ * @brief The job control signals that were at their default action before
+ * start_event_loop() ignored them
+ *
+ * @return The set, suitable for POSIX_SPAWN_SETSIGDEF, or NULL if the loop is
+ * not running
+ */
+const sigset_t* child_default_signals();
+
+/**
+ * @brief Give the calling thread the mask returned by child_signal_mask() and
+ * put back the original actions of the job control signals
+ *
+ * Only async-signal-safe calls are made so this may be used between vfork()
+ * and exec.
+ */
+void reset_child_signals();
+
+/**
+ * @brief Block SIGCHLD and ignore the job control signals again after
+ * reset_child_signals() was used in quash itself
+ */
+void restore_shell_signals();
+
+/**
+ * @brief Close the signalfd, timerfd and epoll instances and restore the
+ * signal mask and actions. Watched descriptors are forgotten but not closed.
+ *
+ * Undoes both watch_child_signals() and start_event_loop().
+ */
+void stop_event_loop();
+
+#endif
@@ -7,43 +7,95 @@
  * @note As you add things to this file you may want to change the method signature
  */
 
+#define _GNU_SOURCE
+
 #include "execute.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <string.h>
 #include <strings.h>
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/prctl.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
 #include "quash.h"
+#include "builtin_io.h"
 #include "deque.h"
+#include "event_loop.h"
+#include "job_log.h"
+#include "jobs.h"
+#include "parsing_interface.h"
+#include "path_cache.h"
+#include "proc_stats.h"
+#include "shm_jobs.h"
+#include "spawn_backend.h"
+#include "utilities.h"
 
 #define BSIZE 256
 #define READ 0
 #define WRITE 1
 
+// Processes of the pipeline being started. They become a Job once every
+// stage is running.
 IMPLEMENT_DEQUE_STRUCT(pidQueue, pid_t);
 IMPLEMENT_DEQUE(pidQueue, pid_t);
 pidQueue pidq;
-bool firstCommand = true;
-
-typedef struct Job
-{
-    int jobID;
-    pidQueue pidq;
-    pid_t jpid;
-    char* cmd;
-} Job;
-
-IMPLEMENT_DEQUE_STRUCT(jobQueue, struct Job);
-IMPLEMENT_DEQUE(jobQueue, struct Job);
-jobQueue jq;
-int currentJID = 1;
 
 static int pipes[2][2];
 
+// How the processes of the pipeline being built are grouped. Background
+// pipelines, and every pipeline of an interactive quash, get a process group
+// of their own. The terminal goes to foreground pipelines when interactive.
+static bool pipeline_group = false;
+static bool pipeline_foreground = false;
+
+// When quash began to start the processes of the pipeline being built, on
+// CLOCK_MONOTONIC. Timed jobs measure from here.
+static struct timespec pipeline_launched;
+
+// Write end of the log pipe of the background pipeline being built or -1.
+// Every stage writes its errors there and the last one its output as well.
+static int pipeline_log_fd = -1;
+
+// Set while a builtin runs in quash's main thread with nothing capturing its
+// output, see run_builtin_in_process()
+static bool builtin_in_quash = false;
+
+// Time limit and budget the timeout and budget builtins put on the command
+// line being run. Every job the line creates gets them.
+static JobTimeout line_timeout;
+static JobBudget line_budget;
+
+// Set while the time builtin runs a line. The foreground job of the line
+// keeps the resource usage of its processes and reports it once it is done.
+static bool line_timed = false;
+static bool line_usage_reported = false;
+
+// Names of the stages of the timed line that got a process, in the order
+// they were started. They line up with the pids of its job.
+static const char** stage_names = NULL;
+static size_t num_stage_names = 0;
+static size_t stage_name_cap = 0;
+
+// Set while bench runs a line. What the jobs of a run used is summed up here
+// instead of being printed.
+static struct rusage* bench_usage = NULL;
+static bool bench_interrupted = false;
+
+static void start_pending_jobs();
+static bool parse_size(const char* str, size_t* out);
+static void report_job_usage(const Job* job);
+
 // Remove this and all expansion calls to it
 /**
  * @brief Note calls to any function that requires implementation
@@ -60,6 +112,10 @@ static int pipes[2][2];
 char* get_current_directory(bool* should_free) {
   char* cwd;
   cwd = get_current_dir_name();
+
+  if (should_free != NULL)
+    *should_free = (cwd != NULL);
+
   return cwd;
 }
 
@@ -68,24 +124,47 @@ const char* lookup_env(const char* env_var) {
   return getenv(env_var);
 }
 
+// Name of the budget a job went over
+static const char* budget_name(BudgetHit hit) {
+  return (hit == BUDGET_CPU) ? "CPU" : "memory";
+}
+
+// Report a finished background job and forget it
+static void report_finished_job(Job* job) {
+  // Jobs made by after that never ran because a job they waited for failed
+  if (job->num_pids == 0) {
+    print_job_skipped(job->id, job->cmd);
+  }
+  else if (job->over_budget != BUDGET_OK) {
+    printf("Completed: \t");
+    print_job_over_budget(job->id, job->pids[job->num_pids - 1], job->cmd,
+                          budget_name(job->over_budget));
+  }
+  else {
+    print_job_bg_complete(job->id, job->pids[job->num_pids - 1], job->cmd);
+  }
+
+  release_job(job);
+}
+
 // Check the status of background jobs
 void check_jobs_bg_status() {
-  // TODO: Check on the statuses of all processes belonging to all background
-  // jobs. This function should remove jobs from the jobs queue once all
-  // processes belonging to a job have completed.
-  //IMPLEMENT_ME();
+  Job* job;
+
+  reap_jobs();
 
-  return;
+  while ((job = take_finished_job()) != NULL)
+    report_finished_job(job);
 
-  // TODO: Once jobs are implemented, uncomment and fill the following line
-  // print_job_bg_complete(job_id, pid, cmd);
+  // Jobs that finished made room for pending ones
+  start_pending_jobs();
 }
 
 // Prints the job id number, the process id of the first process belonging to
 // the Job, and the command string associated with this job
 void print_job(int job_id, pid_t pid, const char* cmd) {
-  printf("[%d]\t%8d\t%s\n", job_id, pid, cmd);
-  fflush(stdout);
+  builtin_printf("[%d]\t%8d\t%s\n", job_id, pid, cmd);
+  builtin_flush();
 }
 
 // Prints a start up message for background processes
@@ -94,12 +173,240 @@ void print_job_bg_start(int job_id, pid_t pid, const char* cmd) {
   print_job(job_id, pid, cmd);
 }
 
+// Prints a job that has not been started. A word for its state takes the
+// place of the PID.
+void print_pending_job(int job_id, const char* state, const char* cmd) {
+  builtin_printf("[%d]\t%8s\t%s\n", job_id, state, cmd);
+  builtin_flush();
+}
+
+// Prints a message for a background job that has to wait for a free slot
+void print_job_bg_queued(int job_id, const char* cmd) {
+  printf("Background job queued: ");
+  print_pending_job(job_id, "Pending", cmd);
+}
+
+// Prints a message for a job made by after that waits for other jobs
+void print_job_bg_waiting(int job_id, const char* cmd) {
+  printf("Background job waiting: ");
+  print_pending_job(job_id, "Waiting", cmd);
+}
+
+// Prints a message for a job made by after that will never run
+void print_job_skipped(int job_id, const char* cmd) {
+  printf("Skipped: \t");
+  print_pending_job(job_id, "-", cmd);
+}
+
 // Prints a completion message followed by the print job
 void print_job_bg_complete(int job_id, pid_t pid, const char* cmd) {
   printf("Completed: \t");
   print_job(job_id, pid, cmd);
 }
 
+// Prints a job that went over its budget. The budget is one more column.
+void print_job_over_budget(int job_id, pid_t pid, const char* cmd,
+                           const char* budget) {
+  builtin_printf("[%d]\t%8d\t%s\tOver %s budget\n", job_id, pid, cmd, budget);
+  builtin_flush();
+}
+
+// Prints a job quash ended on exit with how it ended. A job may still exit
+// on its own once asked to end.
+void print_job_ended(int job_id, pid_t pid, const char* cmd, int status) {
+  if (WIFEXITED(status))
+    printf("Completed: \t");
+  else if (WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL)
+    printf("Killed: \t");
+  else
+    printf("Terminated: \t");
+
+  print_job(job_id, pid, cmd);
+}
+
+// Prints a message for a foreground job that was stopped
+void print_job_stopped(int job_id, pid_t pid, const char* cmd) {
+  printf("Stopped: \t");
+  print_job(job_id, pid, cmd);
+}
+
+/***************************************************************************
+ * Job control
+ ***************************************************************************/
+// Give a job the limits of the command line that created it
+static void apply_line_limits(Job* job) {
+  set_job_timeout(job, &line_timeout);
+  set_job_budget(job, &line_budget);
+}
+
+// True if quash has to stay around to enforce limits on the line or to
+// report what it used
+static bool line_has_limits() {
+  return line_timeout.duration.tv_sec > 0 || line_timeout.duration.tv_nsec > 0
+         || line_budget.rss > 0 || line_budget.cpu.tv_sec > 0
+         || line_budget.cpu.tv_nsec > 0 || line_timed || bench_usage != NULL;
+}
+
+/**
+ * @brief Wait for a job like wait_for_job() while pending background jobs
+ * keep starting as running ones finish
+ *
+ * @param job The job to wait for
+ */
+static void wait_and_schedule(Job* job) {
+  while (has_unstarted_job() && job->state == JOB_RUNNING
+         && wait_for_any_job())
+    start_pending_jobs();
+
+  wait_for_job(job);
+}
+
+/**
+ * @brief Wait for a job holding the terminal
+ *
+ * A job that stops becomes a background job and is reported. Any other job is
+ * released once it is done.
+ *
+ * @param job A foreground job
+ *
+ * @param can_stop False if the job must not be left stopped, for instance
+ * because builtin threads in quash are connected to it. Such a job is
+ * continued whenever it stops.
+ */
+static void wait_for_foreground_job(Job* job, bool can_stop) {
+  give_terminal_to(job);
+  wait_and_schedule(job);
+
+  while (!can_stop && job->state == JOB_STOPPED) {
+    // Continuing it would only get it stopped again by the next sample
+    if (job->over_budget != BUDGET_OK)
+      signal_job(job, SIGKILL);
+
+    resume_job(job);
+    wait_and_schedule(job);
+  }
+
+  take_terminal_back();
+
+  if (job->state != JOB_STOPPED) {
+    if (job->usage != NULL)
+      report_job_usage(job);
+
+    release_job(job);
+    return;
+  }
+
+  char* cmd = (job->cmd == NULL) ? get_command_string() : NULL;
+
+  move_job_to_background(job, cmd);
+
+  if (job->over_budget != BUDGET_OK) {
+    printf("Stopped: \t");
+    print_job_over_budget(job->id, job->pids[0], job->cmd,
+                          budget_name(job->over_budget));
+  }
+  else {
+    // The terminal echoed ^Z without a line break
+    if (job_control_enabled())
+      putchar('\n');
+
+    print_job_stopped(job->id, job->pids[0], job->cmd);
+  }
+
+  free(cmd);
+}
+
+/**
+ * @brief Find the job named by the argument of fg or bg
+ *
+ * @param name Name of the builtin for error messages
+ *
+ * @param spec "%N", "N" or NULL for the most recent job
+ *
+ * @return The job or NULL after printing an error
+ */
+static Job* find_job_spec(const char* name, const char* spec) {
+  Job* job;
+
+  if (spec == NULL) {
+    if ((job = last_job()) == NULL)
+      fprintf(stderr, "%s: no current job\n", name);
+
+    return job;
+  }
+
+  const char* id = (spec[0] == '%') ? spec + 1 : spec;
+
+  if ((job = find_job(atoi(id))) == NULL || job->state == JOB_DONE)
+    fprintf(stderr, "%s: %s: no such job\n", name, spec);
+
+  return (job != NULL && job->state != JOB_DONE) ? job : NULL;
+}
+
+/**
+ * @brief The exit status of a finished job as a shell reports it
+ *
+ * @param job A job that is done
+ *
+ * @return The exit code of its last process, 128 plus the signal that killed
+ * it, 124 if its time limit ran out or 1 if the job never ran
+ */
+static int job_exit_status(const Job* job) {
+  if (job->num_pids == 0)
+    return 1;
+
+  // Like timeout(1), unless SIGKILL was needed
+  if (job->timed_out
+      && !(WIFSIGNALED(job->status) && WTERMSIG(job->status) == SIGKILL))
+    return 124;
+
+  if (WIFSIGNALED(job->status))
+    return 128 + WTERMSIG(job->status);
+
+  return WEXITSTATUS(job->status);
+}
+
+// Reap children and start pending jobs as slots free up until `done` holds
+// for `job`. Gives up once no background job is running, since nothing could
+// change then. A stopped job never finishes on its own.
+static void wait_in_background(bool (*done)(const Job*), const Job* job) {
+  start_pending_jobs();
+
+  while (!done(job) && running_job_count() > 0 && wait_for_any_job())
+    start_pending_jobs();
+}
+
+// A job is through once it is neither running nor waiting to start
+static bool job_settled(const Job* job) {
+  return job->state == JOB_DONE || job->state == JOB_STOPPED;
+}
+
+// True once any background job has finished
+static bool any_job_finished(const Job* job) {
+  (void) job;
+  return has_finished_job();
+}
+
+// True once no background job is running
+static bool no_job_running(const Job* job) {
+  (void) job;
+  return running_job_count() == 0 && !has_pending_job();
+}
+
+// Find the job a wait argument names, "%N" for a job id or any pid of it
+static Job* find_wait_target(const char* arg) {
+  if (arg[0] == '%')
+    return find_job(atoi(arg + 1));
+
+  pid_t pid = atoi(arg);
+  Job* job = find_job_by_pid(pid);
+
+  if (job == NULL)
+    job = find_finished_job(pid);
+
+  return (job != NULL && job->background) ? job : NULL;
+}
+
 /***************************************************************************
  * Functions to process commands
  ***************************************************************************/
@@ -109,32 +416,34 @@ void run_generic(GenericCommand cmd) {
   // Execute a program with a list of arguments. The `args` array is a NULL
   // terminated (last string is always NULL) list of strings. The first element
   // in the array is the executable
-  char* exec = cmd.args[0];
+  const char* exec = lookup_command_path(cmd.args[0]);
   char** args = cmd.args;
 
-  execvp(exec, args);
+  if (exec != NULL)
+    execv(exec, args);
+  else
+    errno = ENOENT;
 
   perror("ERROR: Failed to execute program");
 }
 
-// Print strings
-  //NOTE: This only works for one argument currently and will not print spaces.
+// Print strings separated by spaces
 void run_echo(EchoCommand cmd) {
   // Print an array of strings. The args array is a NULL terminated (last
   // string is always NULL) list of strings.
   char** str = cmd.args;
 
   for(int i =0; str[i] != NULL; i++){
-    printf("%s", str[i]);
-  }
+    if (i > 0)
+      builtin_write(" ", 1);
 
-  putchar('\n');
-
-  //NOTE:
+    builtin_write(str[i], strlen(str[i]));
+  }
 
+  builtin_write("\n", 1);
 
   // Flush the buffer before returning
-  fflush(stdout);
+  builtin_flush();
 }
 
 // Sets an environment variable
@@ -143,6 +452,13 @@ void run_export(ExportCommand cmd) {
   const char* env_var = cmd.env_var;
   const char* val = cmd.val;
   setenv(env_var, val, 1);
+  note_spawn_env_change(env_var);
+
+  if (strcmp(env_var, "QUASH_SPAWN") == 0)
+    reset_spawn_backend();
+
+  if (strcmp(env_var, "PATH") == 0)
+    clear_command_path_cache();
 }
 
 // Changes the current working directory
@@ -160,66 +476,390 @@ void run_cd(CDCommand cmd) {
   chdir(dir);
   setenv("OLD_PWD", oldDir, 1);
   setenv("PWD", dir, 1);
+  note_spawn_env_change("OLD_PWD");
+  note_spawn_env_change("PWD");
+}
+
+// True if a signal ends a process that keeps its default action. Zero only
+// checks that the job exists.
+static bool signal_ends_job(int signal) {
+  switch (signal) {
+  case 0:
+  case SIGCONT:
+  case SIGSTOP:
+  case SIGTSTP:
+  case SIGTTIN:
+  case SIGTTOU:
+  case SIGCHLD:
+  case SIGURG:
+  case SIGWINCH:
+    return false;
+
+  default:
+    return true;
+  }
 }
 
 // Sends a signal to all processes contained in a job
 void run_kill(KillCommand cmd) {
   int signal = cmd.sig;
-  int job_id = cmd.job;
-
-  pidQueue currentPIDQueue;
-  pid_t currentPID;
-  struct Job current;
-
-  for(int i = 0; i < length_jobQueue(&jq); i++){
-    current = pop_front_jobQueue(&jq);
-    if(current.jobID == job_id){
-      currentPIDQueue = current.pidq;
-      while(length_pidQueue(&currentPIDQueue) != 0){
-        currentPID = pop_front_pidQueue(&currentPIDQueue);
-        kill(currentPID, signal);
-      }
-      push_back_jobQueue(&jq, current);
+  Job* job = find_job(cmd.job);
+
+  if (job == NULL) {
+    fprintf(stderr, "kill: %%%d: no such job\n", cmd.job);
+    return;
+  }
+
+  // Already finished and waiting to be reported
+  if (job->state == JOB_DONE)
+    return;
+
+  // There is nothing to signal yet. A signal that would end the job drops it
+  // before it starts and the rest have nothing to act on.
+  if (job->state == JOB_PENDING) {
+    if (!signal_ends_job(signal))
+      return;
+
+    cancel_pending_job(job);
+    free(job->pending);
+    release_job(job);
+    return;
+  }
+
+  signal_job(job, signal);
+
+  // A stopped job only acts on most signals once it runs again
+  if (job->state == JOB_STOPPED && signal != SIGKILL && signal != SIGCONT
+      && signal != SIGSTOP && signal != SIGTSTP && signal != SIGTTIN
+      && signal != SIGTTOU)
+    resume_job(job);
+
+  // SIGKILL cannot be caught, so waiting for its effect is bounded. This
+  // gets the completion reported before the next command runs.
+  if (signal == SIGKILL) {
+    for (size_t i = 0; i < job->num_pids; ++i) {
+      siginfo_t info;
+
+      if (find_job_by_pid(job->pids[i]) == job)
+        waitid(P_PID, job->pids[i], &info, WEXITED | WNOWAIT);
     }
   }
+}
+
+// Continues a job if needed and waits for it in the foreground
+void run_fg(FGCommand cmd) {
+  Job* job = find_job_spec("fg", cmd.args[1]);
+
+  if (job == NULL)
+    return;
+
+  if (job->state == JOB_PENDING) {
+    fprintf(stderr, "fg: %%%d: job has not started\n", job->id);
+    return;
+  }
+
+  printf("%s\n", job->cmd);
+  fflush(stdout);
+
+  move_job_to_foreground(job);
+  give_terminal_to(job);
+
+  if (job->state == JOB_STOPPED)
+    resume_job(job);
+
+  wait_for_foreground_job(job, true);
+}
+
+// Continues a stopped job without waiting for it
+void run_bg(BGCommand cmd) {
+  Job* job = find_job_spec("bg", cmd.args[1]);
+
+  if (job == NULL)
+    return;
+
+  if (job->state == JOB_PENDING) {
+    fprintf(stderr, "bg: %%%d: job has not started\n", job->id);
+    return;
+  }
+
+  if (job->state == JOB_STOPPED)
+    resume_job(job);
+
+  printf("Continued: \t");
+  print_job(job->id, job->pids[0], job->cmd);
+}
 
+// Lists the program location cache. Seeding and clearing happen in quash
+// itself through run_hash_update()
+void run_hash(HashCommand cmd) {
+  if (cmd.args[1] == NULL)
+    print_command_path_cache();
 }
 
+// Seeds the program location cache with each argument or clears it with -r
+void run_hash_update(HashCommand cmd) {
+  for (int i = 1; cmd.args[i] != NULL; ++i) {
+    if (strcmp(cmd.args[i], "-r") == 0)
+      clear_command_path_cache();
+    else if (!seed_command_path(cmd.args[i]))
+      fprintf(stderr, "hash: %s: not found\n", cmd.args[i]);
+  }
+}
 
 // Prints the current working directory to stdout
 void run_pwd() {
-  // TODO: Print the current working directory
-  //char wd[1024];
-  printf("%s\n", get_current_directory(false));
+  bool should_free = false;
+  char* cwd = get_current_directory(&should_free);
+
+  builtin_printf("%s\n", cwd);
+
+  if (should_free)
+    free(cwd);
 
   // Flush the buffer before returning
-  fflush(stdout);
+  builtin_flush();
+}
+
+// Write a byte count the way ls -h does, like 512B, 1.5K or 12M
+static void format_bytes(char* buf, size_t len, uint64_t bytes) {
+  static const char units[] = "BKMGTPE";
+  double value = bytes;
+  int unit = 0;
+
+  while (value >= 1024 && units[unit + 1] != '\0') {
+    value /= 1024;
+    ++unit;
+  }
+
+  if (unit == 0)
+    snprintf(buf, len, "%lluB", (unsigned long long) bytes);
+  else
+    snprintf(buf, len, (value < 10) ? "%.1f%c" : "%.0f%c", value, units[unit]);
 }
 
-// Prints all background jobs currently in the job list to stdout
-void run_jobs() {
-  // TODO: Print background jobs
+// Prints what /proc says about each process of a job on a line of its own.
+// Processes that were reaped or could not be read only show their PID.
+static void print_job_processes(const Job* job) {
+  static long ticks_per_sec = 0;
+  static long page_size = 0;
+  char rss[16];
+  char read_bytes[16];
+  char write_bytes[16];
+
+  if (ticks_per_sec == 0) {
+    ticks_per_sec = sysconf(_SC_CLK_TCK);
+    page_size = sysconf(_SC_PAGESIZE);
+  }
+
+  for (size_t i = 0; i < job->num_pids; ++i) {
+    const ProcStats* stats = NULL;
 
-Job curJob;
+    if (find_job_by_pid(job->pids[i]) == job)
+      stats = cached_proc_stats(job->pids[i]);
 
-if(is_empty_jobQueue(&jq)){
-  return;
+    if (stats == NULL) {
+      builtin_printf("\t%8d\t-\n", job->pids[i]);
+      continue;
+    }
+
+    format_bytes(rss, sizeof(rss), (uint64_t) stats->pages * page_size);
+    format_bytes(read_bytes, sizeof(read_bytes), stats->read_bytes);
+    format_bytes(write_bytes, sizeof(write_bytes), stats->write_bytes);
+
+    builtin_printf("\t%8d\t%c\tcpu %llu.%02llus\trss %s\tread %s\twrite %s"
+                   "\t%s\n", job->pids[i], stats->state,
+                   stats->ticks / ticks_per_sec,
+                   stats->ticks % ticks_per_sec * 100 / ticks_per_sec, rss,
+                   stats->has_io ? read_bytes : "-",
+                   stats->has_io ? write_bytes : "-", stats->comm);
+  }
 }
 
-for(int i = 0; i < length_jobQueue(&jq); i++){
-  curJob = pop_front_jobQueue(&jq);
-  print_job(curJob.jobID, peek_front_pidQueue(&curJob.pidq), curJob.cmd);
-  push_back_jobQueue(&jq, curJob);
+// Sample every live process of every job in one pass. Processes sampled
+// earlier on the same command line come from the cache.
+static void sample_job_processes() {
+  size_t num_pids = 0;
+  size_t n = 0;
+
+  for (Job* job = first_job(); job != NULL; job = next_job(job))
+    num_pids += job->num_pids;
+
+  pid_t* pids = malloc((num_pids + 1) * sizeof(pid_t));
+
+  if (pids == NULL)
+    return;
+
+  for (Job* job = first_job(); job != NULL; job = next_job(job)) {
+    for (size_t i = 0; i < job->num_pids; ++i) {
+      if (find_job_by_pid(job->pids[i]) == job)
+        pids[n++] = job->pids[i];
+    }
+  }
+
+  sample_proc_stats(pids, n);
+  free(pids);
 }
 
+// Prints all background jobs currently in the job list to stdout. With -v
+// each job is followed by its processes.
+void run_jobs(JobsCommand cmd) {
+  bool verbose = false;
+
+  for (int i = 1; cmd.args[i] != NULL; ++i) {
+    if (strcmp(cmd.args[i], "-v") == 0) {
+      verbose = true;
+    }
+    else {
+      fprintf(stderr, "jobs: usage: jobs [-v]\n");
+      return;
+    }
+  }
+
+  if (verbose)
+    sample_job_processes();
+
+  for (Job* job = first_job(); job != NULL; job = next_job(job)) {
+    if (job_is_waiting(job))
+      print_pending_job(job->id, "Waiting", job->cmd);
+    else if (job->state == JOB_PENDING)
+      print_pending_job(job->id, "Pending", job->cmd);
+    else if (job->over_budget != BUDGET_OK)
+      print_job_over_budget(job->id, job->pids[0], job->cmd,
+                            budget_name(job->over_budget));
+    else
+      print_job(job->id, job->pids[0], job->cmd);
+
+    if (verbose)
+      print_job_processes(job);
+  }
+
   // Flush the buffer before returning
-  fflush(stdout);
+  builtin_flush();
+}
+
+// Prints the log of a job, following it with -f when run inside quash
+void run_joblog(JoblogCommand cmd) {
+  char** args = cmd.args;
+  const char* spec = NULL;
+  bool follow = false;
+  char buf[BSIZE * 16];
+  uint64_t pos = 0;
+  int id;
+
+  for (int i = 1; args[i] != NULL; ++i) {
+    if (strcmp(args[i], "-f") == 0)
+      follow = true;
+    else if (spec == NULL && args[i][0] == '%')
+      spec = args[i];
+    else
+      spec = "";
+  }
+
+  if (spec == NULL || spec[0] == '\0' || (id = atoi(spec + 1)) <= 0) {
+    fprintf(stderr, "joblog: usage: joblog %%JOB [-f]\n");
+    return;
+  }
+
+  if (!has_job_log(id)) {
+    fprintf(stderr, "joblog: %s: no log\n", spec);
+    return;
+  }
+
+  for (;;) {
+    uint64_t from = pos;
+    size_t n = read_job_log(id, &pos, buf, sizeof(buf));
+
+    if (pos - n > from)
+      fprintf(stderr, "joblog: %s: %llu bytes were overwritten\n", spec,
+              (unsigned long long) (pos - n - from));
+
+    if (n > 0) {
+      builtin_write(buf, n);
+      continue;
+    }
+
+    if (!follow || !builtin_in_quash || !job_log_is_open(id))
+      break;
+
+    // Hand what is there to the terminal first. Waiting runs the event
+    // loop, which fills the log.
+    builtin_flush();
+    wait_for_child_event();
+    reap_jobs();
+  }
+
+  // Flush the buffer before returning
+  builtin_flush();
+
+  // The job followed is most likely done now
+  if (follow && builtin_in_quash)
+    check_jobs_bg_status();
 }
 
 /***************************************************************************
  * Functions for command resolution and process setup
  ***************************************************************************/
 
+/**
+ * @brief Builtins the parser does not know about. They arrive as a @a
+ * GenericCommand and are matched by the name of the program.
+ */
+static const struct {
+  const char* name;  /**< Name typed by the user */
+  CommandType type;  /**< Type the command is converted to */
+} named_builtins[] = {
+  { "hash", HASH },
+  { "exec", EXEC },
+  { "fg", FG },
+  { "bg", BG },
+  { "after", AFTER },
+  { "wait", WAIT },
+  { "timeout", TIMEOUT },
+  { "budget", BUDGET },
+  { "joblog", JOBLOG },
+  { "time", TIME },
+  { "bench", BENCH },
+};
+
+/**
+ * @brief Convert generic commands that name a builtin into that builtin's @a
+ * CommandType
+ *
+ * Only a lone foreground exec can replace quash. Inside a pipeline or in the
+ * background the process created for it simply is the program, so "exec PROG"
+ * is turned back into a @a GenericCommand running PROG.
+ *
+ * @param holders An array of command holders terminated by an @a EOC command
+ */
+static void resolve_named_builtins(CommandHolder* holders) {
+  bool lone = get_command_holder_type(holders[0]) != EOC
+              && get_command_holder_type(holders[1]) == EOC
+              && !(holders[0].flags & BACKGROUND);
+
+  for (int i = 0; get_command_holder_type(holders[i]) != EOC; ++i) {
+    if (get_command_holder_type(holders[i]) != GENERIC)
+      continue;
+
+    const char* name = holders[i].cmd.generic.args[0];
+
+    for (size_t j = 0; j < sizeof(named_builtins) / sizeof(named_builtins[0]); ++j) {
+      if (strcmp(name, named_builtins[j].name) == 0) {
+        holders[i].cmd.simple.type = named_builtins[j].type;
+        break;
+      }
+    }
+
+    if (get_command_holder_type(holders[i]) == GENERIC && is_utility(name))
+      holders[i].cmd.simple.type = UTILITY;
+
+    if (get_command_holder_type(holders[i]) == EXEC && !lone
+        && holders[i].cmd.exec.args[1] != NULL) {
+      holders[i].cmd.generic.type = GENERIC;
+      ++holders[i].cmd.generic.args;
+    }
+  }
+}
+
 /**
  * @brief A dispatch function to resolve the correct @a Command variant
  * function for child processes.
@@ -229,9 +869,11 @@ for(int i = 0; i < length_jobQueue(&jq); i++){
  *
  * @param cmd The Command to try to run
  *
+ * @return The exit status of the command. Only utilities can fail.
+ *
  * @sa Command
  */
-void child_run_command(Command cmd) {
+int child_run_command(Command cmd) {
   CommandType type = get_command_type(cmd);
   switch (type) {
   case GENERIC:
@@ -247,19 +889,41 @@ void child_run_command(Command cmd) {
     break;
 
   case JOBS:
-    run_jobs();
+    run_jobs(cmd.jobs);
+    break;
+
+  case HASH:
+    run_hash(cmd.hash);
+    break;
+
+  case JOBLOG:
+    run_joblog(cmd.joblog);
     break;
 
+  case UTILITY:
+    return run_utility(cmd.utility);
+
   case EXPORT:
   case CD:
   case KILL:
   case EXIT:
+  case EXEC:
+  case FG:
+  case BG:
+  case AFTER:
+  case WAIT:
+  case TIMEOUT:
+  case BUDGET:
+  case TIME:
+  case BENCH:
   case EOC:
     break;
 
   default:
     fprintf(stderr, "Unknown command type: %d\n", type);
   }
+
+  return 0;
 }
 
 /**
@@ -289,11 +953,52 @@ void parent_run_command(Command cmd) {
     run_kill(cmd.kill);
     break;
 
+  case HASH:
+    run_hash_update(cmd.hash);
+    break;
+
+  case FG:
+    run_fg(cmd.fg);
+    break;
+
+  case BG:
+    run_bg(cmd.bg);
+    break;
+
+  case WAIT:
+    run_wait(cmd.wait);
+    break;
+
+  // run_script() takes care of after, timeout, budget, time and bench at the
+  // start of a line
+  case AFTER:
+    fprintf(stderr, "after: must start the command line\n");
+    break;
+
+  case TIMEOUT:
+    fprintf(stderr, "timeout: must start the command line\n");
+    break;
+
+  case BUDGET:
+    fprintf(stderr, "budget: must start the command line\n");
+    break;
+
+  case TIME:
+    fprintf(stderr, "time: must start the command line\n");
+    break;
+
+  case BENCH:
+    fprintf(stderr, "bench: must start the command line\n");
+    break;
+
   case GENERIC:
   case ECHO:
   case PWD:
   case JOBS:
+  case JOBLOG:
+  case UTILITY:
   case EXIT:
+  case EXEC:
   case EOC:
     break;
 
@@ -302,16 +1007,177 @@ void parent_run_command(Command cmd) {
   }
 }
 
-/**
- * @brief Creates one new process centered around the @a Command in the @a
- * CommandHolder setting up redirects and pipes where needed
- *
- * @note Processes are not the same as jobs. A single job can have multiple
- * processes running under it. This function creates a process that is part of a
- * larger job.
- *
- * @note Not all commands should bld_run_command(holder.cmd); // e run in the child process. A few need to
- * change the quash process in some way
+// Open a file for a '<' redirect
+static int open_redirect_in(const char* file) {
+  return open(file, O_RDONLY | O_CLOEXEC);
+}
+
+// Open a file for a '>' or '>>' redirect
+static int open_redirect_out(const char* file, bool append) {
+  int mode = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+
+  return open(file, mode, 0666);
+}
+
+// Start building a pipeline
+static void begin_pipeline(bool background) {
+  clock_gettime(CLOCK_MONOTONIC, &pipeline_launched);
+  pidq = new_pidQueue(0);
+  pipeline_group = background || job_control_enabled();
+  pipeline_foreground = !background && job_control_enabled();
+}
+
+// Process group the next process of the pipeline joins. The first process
+// leads a new group and the rest join it. -1 keeps quash's group.
+static pid_t next_pipeline_pgid() {
+  if (!pipeline_group)
+    return -1;
+
+  return is_empty_pidQueue(&pidq) ? 0 : peek_front_pidQueue(&pidq);
+}
+
+// Put a process forked from quash into its pipeline's process group. Both
+// sides do this so the group exists before the next process tries to join.
+static void join_pipeline_group(pid_t pid, pid_t pgid) {
+  if (pgid < 0)
+    return;
+
+  if (pid == 0)
+    join_process_group(pgid, pipeline_foreground);
+  else
+    setpgid(pid, (pgid == 0) ? pid : pgid);
+}
+
+/**
+ * @brief Run a builtin at the head of a pipeline without a process of its own
+ *
+ * The output of the builtin is captured in memory and quash writes it into the
+ * pipe itself. That is only safe when all of it fits in the pipe's buffer since
+ * the process reading the pipe has not been started yet. Larger output is
+ * written by a forked child instead.
+ *
+ * @param holder The CommandHolder of the first stage of a pipeline
+ *
+ * @param out_fd Write end of the pipe to the next stage
+ *
+ * @return 0 if the output was delivered by quash, the pid of the child writing
+ * it otherwise or -1 if no child could be created
+ */
+static pid_t run_builtin_into_pipe(CommandHolder holder, int out_fd) {
+  OutBuffer buf = new_out_buffer();
+  bool in_child = false;
+  pid_t pid = 0;
+
+  begin_builtin_capture(&buf);
+  child_run_command(holder.cmd);
+  end_builtin_capture();
+
+  int capacity = fcntl(out_fd, F_GETPIPE_SZ);
+
+  if (capacity < 0 || buf.len > (size_t) capacity) {
+    pid_t pgid = next_pipeline_pgid();
+
+    // The child must not inherit output quash has not written yet
+    fflush(stdout);
+
+    pid = fork();
+    in_child = (pid == 0);
+
+    if (pid >= 0)
+      join_pipeline_group(pid, pgid);
+  }
+
+  // The child must not hold the read end of its own pipe or it would never
+  // notice the reader going away
+  if (in_child) {
+    dup2(out_fd, STDOUT_FILENO);
+    close_range(3, ~0U, 0);
+    out_fd = STDOUT_FILENO;
+  }
+
+  // Either quash or the child writes the captured output
+  if (pid == 0) {
+    for (size_t done = 0; done < buf.len; ) {
+      ssize_t n = write(out_fd, buf.data + done, buf.len - done);
+
+      if (n < 0 && errno != EINTR)
+        break;
+
+      done += (n > 0) ? n : 0;
+    }
+  }
+
+  // The child only holds copies of quash's jobs, logs and shared table, so
+  // the atexit() handlers of quash must not run in it
+  if (in_child)
+    _exit(0);
+
+  destroy_out_buffer(&buf);
+
+  return pid;
+}
+
+// Remember what the next process of a timed line runs. Builtins without
+// arguments are named after their keyword.
+static void add_stage_name(Command cmd) {
+  const char* name;
+
+  switch (get_command_type(cmd)) {
+  case ECHO:
+    name = "echo";
+    break;
+
+  case EXPORT:
+    name = "export";
+    break;
+
+  case CD:
+    name = "cd";
+    break;
+
+  case KILL:
+    name = "kill";
+    break;
+
+  case PWD:
+    name = "pwd";
+    break;
+
+  case EXIT:
+    name = "exit";
+    break;
+
+  default:
+    name = cmd.generic.args[0];
+  }
+
+  if (num_stage_names == stage_name_cap) {
+    size_t cap = (stage_name_cap == 0) ? 16 : stage_name_cap * 2;
+    const char** grown = realloc(stage_names, cap * sizeof(const char*));
+
+    if (grown == NULL)
+      return;
+
+    stage_names = grown;
+    stage_name_cap = cap;
+  }
+
+  stage_names[num_stage_names++] = name;
+}
+
+/**
+ * @brief Creates one new process centered around the @a Command in the @a
+ * CommandHolder setting up redirects and pipes where needed
+ *
+ * @note Processes are not the same as jobs. A single job can have multiple
+ * processes running under it. This function creates a process that is part of a
+ * larger job.
+ *
+ * @note Not all commands should be run in the child process. A few need to
+ * change the quash process in some way
+ *
+ * @note Generic commands are launched with the backend chosen by QUASH_SPAWN
+ * (see spawn_backend.h). Builtins that run in a child always use fork().
  *
  * @param holder The CommandHolder to try to run
  *
@@ -325,111 +1191,1638 @@ void create_process(CommandHolder holder, int pipeEndIndex) {
   bool r_out = holder.flags & REDIRECT_OUT;
   bool r_app = holder.flags & REDIRECT_APPEND; // This can only be true if r_out
                                                // is true
-    (void)r_in;
-    (void)r_out;
-    (void)r_app;
 
   int prevPipe = (pipeEndIndex - 1) % 2;
   int nextPipe = (pipeEndIndex) % 2;
 
+  int in_fd = STDIN_FILENO;
+  int out_fd = STDOUT_FILENO;
+  int err_fd = STDERR_FILENO;
+  const char* exec_path = NULL;
+  pid_t pgid = next_pipeline_pgid();
+  pid_t newPID;
+
+  if (get_command_holder_type(holder) == GENERIC){
+    exec_path = lookup_command_path(holder.cmd.generic.args[0]);
+  }
+
+  // A stage whose input pipe could not be created is not run, and neither is
+  // anything after it
+  bool broken = p_in && pipes[prevPipe][READ] < 0;
+
+  // Close on exec so no other process in the pipeline keeps a stray end open
+  if (p_out && (broken || pipe2(pipes[nextPipe], O_CLOEXEC) < 0)){
+    if (!broken)
+      perror("ERROR: Failed to create pipe");
+
+    pipes[nextPipe][READ] = pipes[nextPipe][WRITE] = -1;
+    broken = true;
+  }
+
+  // Pipes and redirects are opened here in quash so the child only has to
+  // duplicate them onto its standard streams
+  if (p_in){
+    in_fd = pipes[prevPipe][READ];
+  }
   if (p_out){
-    pipe(pipes[nextPipe]);
+    out_fd = pipes[nextPipe][WRITE];
   }
 
-  // TODO: Setup pipes, redirects, and new process
-  pid_t newPID = fork();
-  push_back_pidQueue(&pidq, newPID);
+  // Output that would reach the terminal goes to the job's log instead
+  if (pipeline_log_fd >= 0){
+    err_fd = pipeline_log_fd;
 
-  if (newPID == 0){
-    if(p_in){
-      dup2(pipes[prevPipe][READ], STDIN_FILENO);
-      close(pipes[prevPipe][READ]);
-    }
-    if (p_out){
-      dup2(pipes[nextPipe][WRITE], STDOUT_FILENO);
-      close(pipes[nextPipe][WRITE]);
+    if (!p_out && !r_out)
+      out_fd = pipeline_log_fd;
+  }
+
+  if (r_in){
+    in_fd = open_redirect_in(holder.redirect_in);
+  }
+  if (r_out){
+    out_fd = open_redirect_out(holder.redirect_out, r_app);
+  }
+
+  if (broken) {
+    newPID = -1;
+  }
+  else if (in_fd < 0 || out_fd < 0) {
+    perror("ERROR: Failed to open redirect");
+    newPID = -1;
+  }
+  else if (get_command_holder_type(holder) != GENERIC
+           && get_command_holder_type(holder) != UTILITY && p_out && !p_in) {
+    // Utilities may sleep or write without end, so they get a child like
+    // the programs they stand in for
+    newPID = run_builtin_into_pipe(holder, out_fd);
+  }
+  else if (get_command_holder_type(holder) == GENERIC && exec_path == NULL) {
+    // Nothing in PATH answers to this name. Say so without creating a process.
+    errno = ENOENT;
+    perror("ERROR: Failed to execute program");
+    newPID = -1;
+  }
+  else if (get_command_holder_type(holder) == GENERIC
+           && get_spawn_backend() != SPAWN_FORK) {
+    newPID = spawn_generic(get_spawn_backend(), exec_path,
+                           holder.cmd.generic.args, in_fd, out_fd, err_fd,
+                           pgid, pipeline_foreground);
+
+    if (newPID < 0)
+      perror("ERROR: Failed to execute program");
+  }
+  else {
+    // ps and jobs -v show the program a utility stands in for. The child
+    // takes its name before anything else and closes its end of this pipe,
+    // so quash only goes on once the name is there even if the child is
+    // stopped right away.
+    int named[2] = { -1, -1 };
+
+    if (get_command_holder_type(holder) == UTILITY
+        && pipe2(named, O_CLOEXEC) < 0)
+      named[READ] = named[WRITE] = -1;
+
+    fflush(stdout);
+
+    newPID = fork();
+
+    if (newPID == 0 && get_command_holder_type(holder) == UTILITY) {
+      prctl(PR_SET_NAME, holder.cmd.utility.args[0]);
+
+      if (named[WRITE] >= 0)
+        close(named[WRITE]);
     }
 
-    if (r_in){
-      FILE* f = fopen(holder.redirect_in, "r");
-      dup2(fileno (f), STDIN_FILENO);
+    if (newPID != 0 && named[READ] >= 0) {
+      char c;
+
+      close(named[WRITE]);
+
+      while (newPID > 0 && read(named[READ], &c, 1) < 0 && errno == EINTR);
+
+      close(named[READ]);
     }
 
-    if (r_out){
-      if (r_app){
-        FILE* f = fopen (holder.redirect_out, "a");
-        dup2(fileno (f), STDOUT_FILENO);
-      } else {
-        FILE* f = fopen (holder.redirect_out, "w");
-        dup2(fileno (f), STDOUT_FILENO);
+    if (newPID >= 0)
+      join_pipeline_group(newPID, pgid);
+
+    if (newPID == 0){
+      if (in_fd != STDIN_FILENO){
+        dup2(in_fd, STDIN_FILENO);
+        close(in_fd);
       }
-    }
+      if (out_fd != STDOUT_FILENO){
+        dup2(out_fd, STDOUT_FILENO);
+      }
+      if (err_fd != STDERR_FILENO){
+        dup2(err_fd, STDERR_FILENO);
+      }
+
+      // Leave the child only its standard streams
+      close_range(3, ~0U, 0);
+      reset_child_signals();
+
+      // This should be done in the child branch of a fork. The atexit()
+      // handlers of quash would tear down state the child only has a copy of.
+      int status = child_run_command(holder.cmd);
 
-    child_run_command(holder.cmd); // This should be done in the child branch of a fork
-    exit(0);
-  } else {
-    if (p_out){
-      close(pipes[nextPipe][WRITE]);
+      fflush(stdout);
+      _exit(status);
     }
-    parent_run_command(holder.cmd); // This should be done in the parent branch of
-                                    // a fork
-    pipeEndIndex++;
   }
 
+  if (newPID > 0){
+    push_back_pidQueue(&pidq, newPID);
 
+    if (line_timed)
+      add_stage_name(holder.cmd);
+  }
+
+  // Release quash's copies of everything handed to the child
+  if (p_in && pipes[prevPipe][READ] >= 0){
+    close(pipes[prevPipe][READ]);
+  }
+  if (p_out && pipes[nextPipe][WRITE] >= 0){
+    close(pipes[nextPipe][WRITE]);
+  }
+  if (r_in && in_fd >= 0){
+    close(in_fd);
+  }
+  if (r_out && out_fd >= 0){
+    close(out_fd);
+  }
 
+  parent_run_command(holder.cmd); // This should be done in the parent branch of
+                                  // a fork
 }
 
-// Run a list of commands
-void run_script(CommandHolder* holders) {
-  if (holders == NULL)
-    return;
+/**
+ * @brief Run a builtin inside the quash process without creating a child
+ *
+ * Standard in and standard out are pointed at the redirect files for the
+ * duration of the call and restored afterwards.
+ *
+ * @param holder A CommandHolder holding any command other than a @a
+ * GenericCommand that is neither piped nor in the background
+ *
+ * @sa child_run_command(), parent_run_command()
+ */
+static void run_builtin_in_process(CommandHolder holder) {
+  bool r_in  = holder.flags & REDIRECT_IN;
+  bool r_out = holder.flags & REDIRECT_OUT;
+  bool r_app = holder.flags & REDIRECT_APPEND;
+
+  int saved_in = -1;
+  int saved_out = -1;
+  int fd;
+
+  fflush(stdout);
 
-  if (firstCommand){
-     jq = new_jobQueue(0);
-     firstCommand = false;
+  if (r_in){
+    if ((fd = open_redirect_in(holder.redirect_in)) < 0){
+      perror("ERROR: Failed to open redirect");
+      return;
+    }
+    saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+    dup2(fd, STDIN_FILENO);
+    close(fd);
   }
 
-  check_jobs_bg_status();
+  if (r_out){
+    if ((fd = open_redirect_out(holder.redirect_out, r_app)) < 0){
+      perror("ERROR: Failed to open redirect");
+    }
+    else {
+      saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+      dup2(fd, STDOUT_FILENO);
+      close(fd);
+    }
+  }
 
-  if (get_command_holder_type(holders[0]) == EXIT && get_command_holder_type(holders[1]) == EOC) {
-    end_main_loop();
-    return;
+  if (!r_out || saved_out >= 0){
+    builtin_in_quash = true;
+    child_run_command(holder.cmd);
+    parent_run_command(holder.cmd);
+    builtin_in_quash = false;
+    fflush(stdout);
   }
 
-  pidq = new_pidQueue(0);
-  CommandType type;
+  if (saved_out >= 0){
+    dup2(saved_out, STDOUT_FILENO);
+    close(saved_out);
+  }
+  if (saved_in >= 0){
+    dup2(saved_in, STDIN_FILENO);
+    close(saved_in);
+  }
+}
 
-  // Run all commands in the `holder` array
-  for (int i = 0; (type = get_command_holder_type(holders[i])) != EOC; ++i)
-    create_process(holders[i], i);
+/**
+ * @brief Replace quash with a program
+ *
+ * The redirects of @a holder are applied to quash's own standard streams
+ * first. Without a program to run they stay in place for the commands that
+ * follow, like they do for exec in other shells. If the program cannot be
+ * started the streams are restored and quash carries on.
+ *
+ * @param holder The CommandHolder of a lone foreground command
+ *
+ * @param args A NULL terminated argument list naming the program or an empty
+ * list
+ */
+static void exec_in_place(CommandHolder holder, char** args) {
+  bool r_in  = holder.flags & REDIRECT_IN;
+  bool r_out = holder.flags & REDIRECT_OUT;
+  bool r_app = holder.flags & REDIRECT_APPEND;
+  bool failed = false;
+
+  int saved_in = -1;
+  int saved_out = -1;
+  int fd;
 
-  if (!(holders[0].flags & BACKGROUND)) {
-    // Not a background Job
-    while(!is_empty_pidQueue(&pidq)){
-      pid_t tempPID = pop_front_pidQueue(&pidq);
-      int status;
-      waitpid(tempPID, &status, 0);
+  fflush(stdout);
+
+  // The streams are saved even for a bare exec, which keeps its redirects,
+  // so a redirect that fails does not leave the other one in place
+  if (r_in){
+    if ((fd = open_redirect_in(holder.redirect_in)) < 0){
+      perror("ERROR: Failed to open redirect");
+      return;
     }
-    destroy_pidQueue(&pidq);
+    saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 0);
+    dup2(fd, STDIN_FILENO);
+    close(fd);
+  }
 
+  if (r_out){
+    if ((fd = open_redirect_out(holder.redirect_out, r_app)) < 0){
+      perror("ERROR: Failed to open redirect");
+      failed = true; // Restore stdin below and give up
+    }
+    else {
+      saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 0);
+      dup2(fd, STDOUT_FILENO);
+      close(fd);
+    }
+  }
 
+  // The program would not remove the shared job table on exit. It is
+  // published again if quash carries on.
+  if (!failed && args[0] != NULL) {
+    close_job_table();
+    reset_child_signals();
+    run_generic((GenericCommand) { GENERIC, args }); // Only returns on failure
+    restore_shell_signals();
+    failed = true;
   }
-  else {
-    // A background job.
-    Job newJob;
-    newJob.jobID = currentJID;
-    currentJID++;
-    newJob.pidq = pidq;
-    newJob.cmd = get_command_string();
-    if (!is_empty_pidQueue(&pidq)){
-      newJob.jpid = peek_back_pidQueue(&pidq);
-    } else {
-      fprintf(stderr, "No Process ID Delivered\n");
+
+  if (saved_out >= 0){
+    if (failed)
+      dup2(saved_out, STDOUT_FILENO);
+    close(saved_out);
+  }
+  if (saved_in >= 0){
+    if (failed)
+      dup2(saved_in, STDIN_FILENO);
+    close(saved_in);
+  }
+}
+
+/**
+ * @brief A builtin running in a thread of its own as one stage of a pipeline
+ */
+typedef struct BuiltinStage {
+  CommandHolder holder; /**< The stage to run */
+  int in_fd;            /**< Input descriptor owned by the stage or -1 */
+  Ring* in_ring;        /**< Ring from the previous builtin stage or NULL */
+  int out_fd;           /**< Descriptor to write to or -1 to use @a out_ring */
+  bool close_out;       /**< True if @a out_fd is owned by the stage */
+  Ring* out_ring;       /**< Ring to the next builtin stage or NULL */
+  bool started;         /**< True if @a thread was created */
+  pthread_t thread;     /**< The thread running the stage */
+  bool rendered;        /**< True if quash already ran the builtin into
+                         * @a output and the thread only copies it */
+  OutBuffer output;     /**< Output of a rendered builtin */
+} BuiltinStage;
+
+// Ring capacity between two builtin stages, the same as a default pipe
+#define STAGE_RING_SIZE (64 * 1024)
+
+// True if QUASH_BUILTIN_THREADS asks for builtins in pipelines to run as
+// threads
+static bool use_builtin_threads() {
+  const char* value = getenv("QUASH_BUILTIN_THREADS");
+
+  return value != NULL && *value != '\0' && strcmp(value, "0") != 0;
+}
+
+// Release both ends of a builtin stage so its neighbours see end of file or a
+// closed reader
+static void finish_builtin_stage(BuiltinStage* stage) {
+  if (stage->out_ring != NULL)
+    ring_close_writer(stage->out_ring);
+  if (stage->close_out)
+    close(stage->out_fd);
+
+  if (stage->in_ring != NULL)
+    ring_close_reader(stage->in_ring);
+  if (stage->in_fd >= 0)
+    close(stage->in_fd);
+}
+
+// Thread body of a builtin stage
+static void* run_builtin_stage(void* arg) {
+  BuiltinStage* stage = arg;
+  sigset_t pipe_set;
+
+  // A closed pipe must fail the write instead of killing quash
+  sigemptyset(&pipe_set);
+  sigaddset(&pipe_set, SIGPIPE);
+  pthread_sigmask(SIG_BLOCK, &pipe_set, NULL);
+
+  if (stage->in_ring != NULL)
+    builtin_input_from_ring(stage->in_ring);
+  else if (stage->in_fd >= 0)
+    builtin_input_from_fd(stage->in_fd);
+
+  if (stage->out_fd >= 0)
+    builtin_output_to_fd(stage->out_fd);
+  else
+    builtin_output_to_ring(stage->out_ring);
+
+  if (stage->rendered)
+    builtin_write(stage->output.data, stage->output.len);
+  else
+    child_run_command(stage->holder.cmd);
+
+  builtin_flush();
+
+  finish_builtin_stage(stage);
+
+  return NULL;
+}
+
+// Turn the processes collected in pidq into a foreground job
+static Job* new_pipeline_job() {
+  size_t num_pids;
+  pid_t* pids = as_array_pidQueue(&pidq, &num_pids);
+  pid_t pgid = (pipeline_group && num_pids > 0) ? pids[0] : 0;
+
+  Job* job = new_job(pids, num_pids, pgid, NULL, false);
+
+  apply_line_limits(job);
+
+  if (line_timed || bench_usage != NULL)
+    record_job_usage(job, &pipeline_launched);
+
+  free(pids);
+
+  return job;
+}
+
+/**
+ * @brief Turn the processes collected in @a pidq into a foreground job and
+ * wait for all of them
+ *
+ * @param can_stop False if the job must be kept running, see
+ * wait_for_foreground_job()
+ */
+static void wait_for_pipeline(bool can_stop) {
+  wait_for_foreground_job(new_pipeline_job(), can_stop);
+}
+
+// True if a builtin reads the job table, the job logs or the path cache.
+// Quash changes those while it waits for the pipeline, so such a builtin runs
+// before any thread starts and its thread only copies the output.
+static bool reads_shell_state(CommandHolder holder) {
+  CommandType type = get_command_holder_type(holder);
+
+  return type == JOBS || type == HASH || type == JOBLOG;
+}
+
+// True if a stage of a threaded pipeline runs as a thread. A sleep gets a
+// child so the terminal can interrupt it.
+static bool runs_as_thread(CommandHolder holder) {
+  CommandType type = get_command_holder_type(holder);
+
+  return type != GENERIC
+         && (type != UTILITY || !utility_sleeps(holder.cmd.utility));
+}
+
+/**
+ * @brief Run a foreground pipeline with its builtins as threads inside quash
+ *
+ * Consecutive builtins are connected by @a Ring buffers. A pipe is only
+ * created where a builtin meets an external program. Programs are started
+ * first and the builtin threads afterwards so no thread runs while quash
+ * creates the processes of the pipeline. The job is registered and builtins
+ * that read the shell's state are run before any thread starts, so the
+ * threads never look at what quash changes while it waits.
+ *
+ * @param holders An array of command holders terminated by an @a EOC command
+ *
+ * @sa Ring
+ */
+static void run_pipeline_with_threads(CommandHolder* holders) {
+  int count = 0;
+
+  while (get_command_holder_type(holders[count]) != EOC)
+    ++count;
+
+  BuiltinStage stages[count];
+  Ring* prev_ring = NULL;
+
+  begin_pipeline(false);
+
+  for (int i = 0; i < count; ++i) {
+    BuiltinStage* stage = &stages[i];
+    bool builtin = runs_as_thread(holders[i]);
+    bool next_builtin = i + 1 < count && runs_as_thread(holders[i + 1]);
+    bool next_external = i + 1 < count && !next_builtin;
+
+    *stage = (BuiltinStage) {
+      holders[i], -1, prev_ring, -1, false, NULL, false, 0, false,
+      new_out_buffer()
+    };
+    prev_ring = NULL;
+
+    if (!builtin) {
+      create_process(holders[i], i);
+      continue;
+    }
+
+    if (i > 0 && stage->in_ring == NULL)
+      stage->in_fd = pipes[(i - 1) % 2][READ];
+
+    if (holders[i].flags & REDIRECT_IN) {
+      if (stage->in_fd >= 0)
+        close(stage->in_fd);
+
+      if ((stage->in_fd = open_redirect_in(holders[i].redirect_in)) < 0)
+        perror("ERROR: Failed to open redirect");
+    }
+
+    if (next_builtin)
+      prev_ring = stage->out_ring = new_ring(STAGE_RING_SIZE);
+
+    if (next_external && pipe2(pipes[i % 2], O_CLOEXEC) < 0) {
+      perror("ERROR: Failed to create pipe");
+      pipes[i % 2][READ] = pipes[i % 2][WRITE] = -1;
+    }
+
+    if (holders[i].flags & REDIRECT_OUT) {
+      stage->out_fd = open_redirect_out(holders[i].redirect_out,
+                                        holders[i].flags & REDIRECT_APPEND);
+      stage->close_out = stage->out_fd >= 0;
+
+      // The next program gets an empty pipe like it would from a shell
+      if (next_external && pipes[i % 2][WRITE] >= 0)
+        close(pipes[i % 2][WRITE]);
+
+      if (stage->out_fd < 0)
+        perror("ERROR: Failed to open redirect");
     }
-    push_back_jobQueue(&jq, newJob);
+    else if (next_external) {
+      stage->out_fd = pipes[i % 2][WRITE];
+      stage->close_out = stage->out_fd >= 0;
+    }
+    else if (!next_builtin) {
+      stage->out_fd = STDOUT_FILENO;
+    }
+
+    // Builtins that change quash run here, in order, like they would from
+    // create_process()
+    parent_run_command(holders[i].cmd);
+
+    if (reads_shell_state(holders[i])) {
+      begin_builtin_capture(&stage->output);
+      child_run_command(holders[i].cmd);
+      end_builtin_capture();
+      stage->rendered = true;
+    }
+  }
+
+  fflush(stdout);
+
+  Job* job = new_pipeline_job();
+
+  for (int i = 0; i < count; ++i) {
+    BuiltinStage* stage = &stages[i];
+    bool builtin = runs_as_thread(stage->holder);
+    bool failed_in = (stage->holder.flags & REDIRECT_IN) && stage->in_fd < 0;
+    bool failed_out = stage->out_fd < 0 && stage->out_ring == NULL;
+
+    if (!builtin)
+      continue;
+
+    if (failed_in || failed_out
+        || pthread_create(&stage->thread, NULL, run_builtin_stage, stage) != 0)
+      finish_builtin_stage(stage);
+    else
+      stage->started = true;
+  }
+
+  // The threads cannot be suspended along with the processes they feed
+  wait_for_foreground_job(job, false);
+
+  for (int i = 0; i < count; ++i) {
+    if (stages[i].started)
+      pthread_join(stages[i].thread, NULL);
+  }
 
-    print_job_bg_start(newJob.jobID, newJob.jpid, newJob.cmd);
+  for (int i = 0; i < count; ++i) {
+    destroy_ring(stages[i].out_ring);
+    destroy_out_buffer(&stages[i].output);
+  }
+}
 
+/***************************************************************************
+ * Scheduler
+ ***************************************************************************/
+// Default job limit on machines with fewer CPUs. Many background jobs spend
+// their time waiting rather than computing, so a couple of them should always
+// be able to overlap.
+#define MIN_DEFAULT_JOBS 4
+
+// Number of background jobs allowed to run at once. QUASH_MAX_JOBS sets it,
+// 0 meaning no limit, and it defaults to the number of online CPUs.
+static size_t job_limit() {
+  static long cpus = 0;
+  const char* value = getenv("QUASH_MAX_JOBS");
+
+  if (value != NULL && *value != '\0') {
+    char* end;
+    long limit = strtol(value, &end, 10);
+
+    if (*end == '\0' && limit >= 0)
+      return limit;
   }
+
+  if (cpus == 0 && (cpus = sysconf(_SC_NPROCESSORS_ONLN)) < MIN_DEFAULT_JOBS)
+    cpus = MIN_DEFAULT_JOBS;
+
+  return cpus;
+}
+
+// Size of the log a background job's output goes to. 0 if QUASH_JOBLOG_SIZE
+// is unset, invalid or larger than JOB_LOG_MAX and the output goes to the
+// terminal.
+static size_t job_log_size() {
+  const char* value = getenv("QUASH_JOBLOG_SIZE");
+  size_t size;
+
+  if (value == NULL || !parse_size(value, &size) || size > JOB_LOG_MAX)
+    return 0;
+
+  return size;
+}
+
+// True if another background job may start right now
+static bool has_free_slot() {
+  size_t limit = job_limit();
+
+  return limit == 0 || running_job_count() < limit;
+}
+
+// True if a stage changes quash itself. Such pipelines are never queued so
+// the change happens when the user asked for it.
+static bool changes_quash(CommandHolder* holders) {
+  for (int i = 0; get_command_holder_type(holders[i]) != EOC; ++i) {
+    switch (get_command_holder_type(holders[i])) {
+    case EXPORT:
+    case CD:
+    case KILL:
+    case HASH:
+    case FG:
+    case BG:
+    case AFTER:
+    case WAIT:
+    case EXIT:
+    case EXEC:
+      return true;
+
+    default:
+      break;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * @brief Start the processes of a background pipeline and report the job
+ *
+ * @param holders An array of command holders terminated by an @a EOC command
+ *
+ * @param pending The pending job the pipeline was queued as or NULL to create
+ * a new job
+ */
+static void start_background_job(CommandHolder* holders, Job* pending) {
+  int log_pipe[2] = { -1, -1 };
+  size_t log_size = job_log_size();
+
+  // Without the event loop to drain it the pipe would fill up and stall the
+  // job, so the output is only captured while SIGCHLD is watched
+  if (log_size > 0 && child_signal_mask() != NULL
+      && pipe2(log_pipe, O_CLOEXEC) < 0) {
+    perror("ERROR: Failed to create job log");
+    log_pipe[READ] = log_pipe[WRITE] = -1;
+  }
+
+  begin_pipeline(true);
+  pipeline_log_fd = log_pipe[WRITE];
+
+  for (int i = 0; get_command_holder_type(holders[i]) != EOC; ++i)
+    create_process(holders[i], i);
+
+  pipeline_log_fd = -1;
+
+  if (log_pipe[WRITE] >= 0)
+    close(log_pipe[WRITE]);
+
+  if (is_empty_pidQueue(&pidq)) {
+    fprintf(stderr, "No Process ID Delivered\n");
+    destroy_pidQueue(&pidq);
+
+    if (log_pipe[READ] >= 0)
+      close(log_pipe[READ]);
+
+    if (pending != NULL)
+      release_job(pending);
+
+    return;
+  }
+
+  size_t num_pids;
+  pid_t* pids = as_array_pidQueue(&pidq, &num_pids);
+  Job* job = pending;
+
+  if (job != NULL) {
+    start_pending_job(job, pids, num_pids, pids[0]);
+  }
+  else {
+    char* cmd = get_command_string();
+
+    job = new_job(pids, num_pids, pids[0], cmd, true);
+    apply_line_limits(job);
+    free(cmd);
+  }
+
+  // A log left by an earlier job with the same id is replaced or dropped
+  if (log_pipe[READ] < 0 || !start_job_log(job->id, log_pipe[READ], log_size))
+    drop_job_log(job->id);
+
+  print_job_bg_start(job->id, pids[num_pids - 1], job->cmd);
+  free(pids);
+}
+
+// Start pending jobs, oldest first, while there are free slots
+static void start_pending_jobs() {
+  Job* job;
+
+  while (has_free_slot() && (job = take_pending_job()) != NULL) {
+    CommandHolder* holders = job->pending;
+
+    start_background_job(holders, job);
+    free(holders);
+  }
+}
+
+/**
+ * @brief Start a background pipeline now or queue it until a slot is free
+ *
+ * Jobs start in the order they were given, so a new job waits behind any job
+ * that is already pending.
+ *
+ * @param holders An array of command holders terminated by an @a EOC command
+ */
+static void schedule_background_job(CommandHolder* holders) {
+  if ((has_free_slot() && !has_pending_job()) || changes_quash(holders)) {
+    start_background_job(holders, NULL);
+    return;
+  }
+
+  CommandHolder* copy = copy_script(holders);
+  char* cmd = get_command_string();
+
+  if (copy == NULL) {
+    fprintf(stderr, "ERROR: Failed to queue job\n");
+    free(cmd);
+    return;
+  }
+
+  Job* job = new_pending_job(cmd, copy);
+
+  apply_line_limits(job);
+  print_job_bg_queued(job->id, job->cmd);
+  free(cmd);
+}
+
+// Waits for jobs to finish and reports the exit status a shell would return
+void run_wait(WaitCommand cmd) {
+  char** args = cmd.args;
+  int status = 0;
+
+  if (args[1] == NULL) {
+    wait_in_background(no_job_running, NULL);
+    check_jobs_bg_status();
+    return;
+  }
+
+  if (strcmp(args[1], "-n") == 0) {
+    wait_in_background(any_job_finished, NULL);
+
+    Job* job = take_finished_job();
+
+    // 127 like a shell that has no job to wait for
+    status = (job != NULL) ? job_exit_status(job) : 127;
+
+    if (job != NULL)
+      report_finished_job(job);
+  }
+  else {
+    for (int i = 1; args[i] != NULL; ++i) {
+      Job* job = find_wait_target(args[i]);
+
+      if (job == NULL) {
+        fprintf(stderr, "wait: %s: no such job\n", args[i]);
+        status = 127;
+        continue;
+      }
+
+      wait_in_background(job_settled, job);
+
+      if (job->state == JOB_DONE)
+        status = job_exit_status(job);
+      else if (job->state == JOB_STOPPED)
+        status = 128 + job->stop_signal;
+    }
+  }
+
+  check_jobs_bg_status();
+  printf("Exit status: %d\n", status);
+  fflush(stdout);
+}
+
+// Queue the command line after the job specs until those jobs have finished
+void run_after(CommandHolder* holders) {
+  char** args = holders[0].cmd.after.args;
+  bool only_on_success = false;
+  int count = 0;
+  int i = 1;
+
+  if (args[i] != NULL && strcmp(args[i], "-s") == 0) {
+    only_on_success = true;
+    ++i;
+  }
+
+  int first_spec = i;
+
+  while (args[i] != NULL && args[i][0] == '%')
+    ++i;
+
+  int num_deps = i - first_spec;
+
+  if (args[i] != NULL && strcmp(args[i], "--") == 0)
+    ++i;
+
+  if (num_deps == 0 || args[i] == NULL) {
+    fprintf(stderr, "after: usage: after [-s] %%JOB... [--] COMMAND\n");
+    return;
+  }
+
+  Job* deps[num_deps];
+
+  for (int j = 0; j < num_deps; ++j) {
+    const char* spec = args[first_spec + j];
+
+    if ((deps[j] = find_job(atoi(spec + 1))) == NULL) {
+      fprintf(stderr, "after: %s: no such job\n", spec);
+      return;
+    }
+  }
+
+  while (get_command_holder_type(holders[count]) != EOC)
+    ++count;
+
+  // The command after the job specs becomes the first stage. It keeps the
+  // redirects and pipe of the line.
+  CommandHolder line[count + 1];
+
+  memcpy(line, holders, sizeof(line));
+  line[0].cmd = mk_generic_command(args + i);
+
+  CommandHolder* copy = copy_script(line);
+  char* cmd = get_command_string();
+
+  if (copy == NULL) {
+    fprintf(stderr, "ERROR: Failed to queue job\n");
+    free(cmd);
+    return;
+  }
+
+  Job* job = new_dependent_job(cmd, copy, deps, num_deps, only_on_success);
+
+  free(cmd);
+
+  if (job_is_waiting(job)) {
+    print_job_bg_waiting(job->id, job->cmd);
+    return;
+  }
+
+  // Every job it names is done already
+  start_pending_jobs();
+
+  if (job->state == JOB_PENDING)
+    print_job_bg_queued(job->id, job->cmd);
+}
+
+// The rest of the line runs like any other line. Only the jobs it creates
+// carry the time limit.
+void run_timeout(CommandHolder* holders) {
+  char** args = holders[0].cmd.timeout.args;
+  JobTimeout timeout = { { 0, 0 }, { 0, 0 } };
+  bool has_duration = false;
+  int i = 1;
+
+  while (args[i] != NULL && !has_duration) {
+    if (strcmp(args[i], "-k") == 0) {
+      if (args[i + 1] == NULL || !parse_duration(args[i + 1], &timeout.kill_after))
+        break;
+
+      i += 2;
+    }
+    else if (parse_duration(args[i], &timeout.duration)) {
+      has_duration = true;
+      ++i;
+    }
+    else {
+      break;
+    }
+  }
+
+  if (has_duration && args[i] != NULL && strcmp(args[i], "-k") == 0) {
+    if (args[i + 1] != NULL && parse_duration(args[i + 1], &timeout.kill_after))
+      i += 2;
+    else
+      has_duration = false;
+  }
+
+  if (has_duration && args[i] != NULL && strcmp(args[i], "--") == 0)
+    ++i;
+
+  if (!has_duration || args[i] == NULL) {
+    fprintf(stderr,
+            "timeout: usage: timeout DURATION [-k KILL_AFTER] [--] COMMAND\n");
+    return;
+  }
+
+  // Jobs show the line as it was typed. The string is made once and cached,
+  // so that has to happen before the line is changed.
+  free(get_command_string());
+
+  holders[0].cmd = mk_generic_command(args + i);
+  line_timeout = timeout;
+  run_script(holders);
+  line_timeout = (JobTimeout) { { 0, 0 }, { 0, 0 } };
+}
+
+/**
+ * @brief Read a memory size
+ *
+ * @param str A non-negative number of bytes, optionally followed by "K", "M",
+ * "G" or "T" for powers of 1024
+ *
+ * @param out Where the size goes
+ *
+ * @return True if @a str is a valid size
+ */
+static bool parse_size(const char* str, size_t* out) {
+  char* end;
+  double bytes = strtod(str, &end);
+
+  if (end == str || !isfinite(bytes) || bytes < 0)
+    return false;
+
+  switch (toupper((unsigned char) *end)) {
+  case 'T':
+    bytes *= 1024;
+    // fall through
+  case 'G':
+    bytes *= 1024;
+    // fall through
+  case 'M':
+    bytes *= 1024;
+    // fall through
+  case 'K':
+    bytes *= 1024;
+    ++end;
+    // fall through
+  case '\0':
+    break;
+
+  default:
+    return false;
+  }
+
+  if (*end != '\0' || bytes > (double) (SIZE_MAX / 2))
+    return false;
+
+  *out = (size_t) bytes;
+
+  return true;
+}
+
+// A job spec changes the budget of that job. Otherwise the rest of the line
+// runs like any other line and the jobs it creates get the budget.
+void run_budget(CommandHolder* holders) {
+  char** args = holders[0].cmd.budget.args;
+  JobBudget budget = { { 0, 0 }, 0, false };
+  bool has_dashes = false;
+  bool ok = true;
+  int i = 1;
+
+  for (; ok && args[i] != NULL && args[i][0] == '-'; ++i) {
+    if (strcmp(args[i], "--") == 0) {
+      has_dashes = true;
+      ++i;
+      break;
+    }
+
+    if (strcmp(args[i], "-k") == 0)
+      budget.kill = true;
+    else if (strcmp(args[i], "-c") == 0 && args[i + 1] != NULL)
+      ok = parse_duration(args[++i], &budget.cpu);
+    else if (strcmp(args[i], "-m") == 0 && args[i + 1] != NULL)
+      ok = parse_size(args[++i], &budget.rss);
+    else
+      ok = false;
+  }
+
+  if (!ok || args[i] == NULL) {
+    fprintf(stderr, "budget: usage: budget [-c CPU_TIME] [-m MEMORY] [-k] "
+            "{%%JOB | [--] COMMAND}\n");
+    return;
+  }
+
+  // Read every time like QUASH_MAX_JOBS so an export takes effect
+  const char* value = getenv("QUASH_BUDGET_INTERVAL");
+  struct timespec interval = { 1, 0 };
+
+  if (value == NULL || !parse_duration(value, &interval)
+      || (interval.tv_sec == 0 && interval.tv_nsec == 0))
+    interval = (struct timespec) { 1, 0 };
+
+  set_budget_interval(&interval);
+
+  if (!has_dashes && args[i][0] == '%' && args[i + 1] == NULL) {
+    Job* job = find_job(atoi(args[i] + 1));
+
+    if (job == NULL || job->state == JOB_DONE)
+      fprintf(stderr, "budget: %s: no such job\n", args[i]);
+    else
+      set_job_budget(job, &budget);
+
+    return;
+  }
+
+  // Jobs show the line as it was typed, see run_timeout()
+  free(get_command_string());
+
+  holders[0].cmd = mk_generic_command(args + i);
+  line_budget = budget;
+  run_script(holders);
+  line_budget = (JobBudget) { { 0, 0 }, 0, false };
+}
+
+// Write seconds and microseconds with millisecond precision
+static void format_seconds(char* buf, size_t len, long sec, long usec) {
+  snprintf(buf, len, "%ld.%03lds", sec, usec / 1000);
+}
+
+// Time from `from` to `to` in seconds and microseconds, never negative
+static void elapsed_since(const struct timespec* from,
+                          const struct timespec* to, long* sec, long* usec) {
+  long long nsec = (to->tv_sec - from->tv_sec) * 1000000000LL
+                   + (to->tv_nsec - from->tv_nsec);
+
+  if (nsec < 0)
+    nsec = 0;
+
+  *sec = nsec / 1000000000LL;
+  *usec = nsec % 1000000000LL / 1000;
+}
+
+// Print one row of the report of time
+static void print_usage_row(const char* label, long real_sec, long real_usec,
+                            const struct rusage* ru, const char* name) {
+  char real[32];
+  char user[32];
+  char sys[32];
+  char rss[16];
+
+  format_seconds(real, sizeof(real), real_sec, real_usec);
+  format_seconds(user, sizeof(user), ru->ru_utime.tv_sec, ru->ru_utime.tv_usec);
+  format_seconds(sys, sizeof(sys), ru->ru_stime.tv_sec, ru->ru_stime.tv_usec);
+  format_bytes(rss, sizeof(rss), (uint64_t) ru->ru_maxrss * 1024);
+
+  fprintf(stderr, "%s\t%s\t%s\t%s\t%s\t%ld\t%ld\t%ld\t%ld\t%s\n", label, real,
+          user, sys, rss, ru->ru_majflt, ru->ru_minflt, ru->ru_nvcsw,
+          ru->ru_nivcsw, name);
+}
+
+// Add the usage of one process to a sum
+static void add_usage(struct rusage* sum, const struct rusage* ru) {
+  timeradd(&sum->ru_utime, &ru->ru_utime, &sum->ru_utime);
+  timeradd(&sum->ru_stime, &ru->ru_stime, &sum->ru_stime);
+  sum->ru_maxrss += ru->ru_maxrss;
+  sum->ru_majflt += ru->ru_majflt;
+  sum->ru_minflt += ru->ru_minflt;
+  sum->ru_nvcsw += ru->ru_nvcsw;
+  sum->ru_nivcsw += ru->ru_nivcsw;
+}
+
+static const char usage_header[] =
+  "PID\tREAL\tUSER\tSYS\tMAXRSS\tMAJFLT\tMINFLT\tVCSW\tIVCSW\tCOMMAND\n";
+
+// Print what each process of a timed job used and the sum over all of them
+// to standard error. The stages of a pipeline run at the same time, so their
+// peak memory is summed as well. A job finished by fg after it was stopped no
+// longer knows its stage names.
+static void report_job_usage(const Job* job) {
+  struct rusage total;
+  struct timespec last = job->launched;
+  bool named = line_timed && num_stage_names == job->num_pids;
+  char pid[16];
+  long sec, usec;
+
+  if (bench_usage != NULL) {
+    for (size_t i = 0; i < job->num_pids; ++i) {
+      if (job->usage[i].reaped)
+        add_usage(bench_usage, &job->usage[i].rusage);
+    }
+
+    // Ctrl-C ends the benchmark, not just the run
+    bench_interrupted |= WIFSIGNALED(job->status)
+                         && WTERMSIG(job->status) == SIGINT;
+    return;
+  }
+
+  memset(&total, 0, sizeof(total));
+  fputs(usage_header, stderr);
+
+  for (size_t i = 0; i < job->num_pids; ++i) {
+    const ProcessUsage* usage = &job->usage[i];
+
+    if (!usage->reaped)
+      continue;
+
+    if (usage->ended.tv_sec > last.tv_sec
+        || (usage->ended.tv_sec == last.tv_sec
+            && usage->ended.tv_nsec > last.tv_nsec))
+      last = usage->ended;
+
+    snprintf(pid, sizeof(pid), "%8d", job->pids[i]);
+    elapsed_since(&job->launched, &usage->ended, &sec, &usec);
+    print_usage_row(pid, sec, usec, &usage->rusage,
+                    named ? stage_names[i] : "-");
+    add_usage(&total, &usage->rusage);
+  }
+
+  elapsed_since(&job->launched, &last, &sec, &usec);
+  print_usage_row("total", sec, usec, &total, "-");
+  line_usage_reported = true;
+}
+
+// The rest of the line runs like any other line. Its foreground job reports
+// what it used. A line without processes reports what quash itself used
+// while running it.
+void run_time(CommandHolder* holders) {
+  char** args = holders[0].cmd.time.args;
+  struct timespec start, end;
+  struct rusage self_start, self_end;
+  int i = 1;
+
+  if (args[i] != NULL && strcmp(args[i], "--") == 0)
+    ++i;
+
+  if (args[i] == NULL || (holders[0].flags & BACKGROUND)) {
+    fprintf(stderr, "time: usage: time [--] COMMAND, in the foreground\n");
+    return;
+  }
+
+  // Jobs show the line as it was typed, see run_timeout()
+  free(get_command_string());
+
+  holders[0].cmd = mk_generic_command(args + i);
+  num_stage_names = 0;
+  line_usage_reported = false;
+  line_timed = true;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  getrusage(RUSAGE_SELF, &self_start);
+  run_script(holders);
+  getrusage(RUSAGE_SELF, &self_end);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  line_timed = false;
+
+  if (line_usage_reported)
+    return;
+
+  struct rusage used;
+  long sec, usec;
+
+  used = self_end;
+  timersub(&self_end.ru_utime, &self_start.ru_utime, &used.ru_utime);
+  timersub(&self_end.ru_stime, &self_start.ru_stime, &used.ru_stime);
+  used.ru_majflt -= self_start.ru_majflt;
+  used.ru_minflt -= self_start.ru_minflt;
+  used.ru_nvcsw -= self_start.ru_nvcsw;
+  used.ru_nivcsw -= self_start.ru_nivcsw;
+
+  elapsed_since(&start, &end, &sec, &usec);
+  fputs(usage_header, stderr);
+  print_usage_row("total", sec, usec, &used, "quash");
+}
+
+/**
+ * @brief Figures bench reports for one measure over all runs
+ */
+typedef struct BenchSummary {
+  double min;      /**< Fastest run in seconds */
+  double median;   /**< Middle run, or the mean of the two middle runs */
+  double p95;      /**< No more than 5% of the runs took longer */
+  double max;      /**< Slowest run */
+  size_t outliers; /**< Runs more than 1.5 IQR beyond the quartiles */
+} BenchSummary;
+
+// Order seconds ascending
+static int compare_seconds(const void* a, const void* b) {
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+
+  return (x > y) - (x < y);
+}
+
+// Value below which `fraction` of the sorted samples lie, by linear
+// interpolation between the closest ranks
+static double quantile(const double* sorted, size_t n, double fraction) {
+  double rank = fraction * (n - 1);
+  size_t low = (size_t) rank;
+
+  if (low + 1 >= n)
+    return sorted[n - 1];
+
+  return sorted[low] + (rank - low) * (sorted[low + 1] - sorted[low]);
+}
+
+// Sort a copy of the samples and pick the figures out of it. Outliers are
+// found with Tukey's fences, which need no assumption about the shape of the
+// distribution.
+static BenchSummary summarize(const double* samples, size_t n) {
+  double sorted[n];
+
+  memcpy(sorted, samples, n * sizeof(double));
+  qsort(sorted, n, sizeof(double), compare_seconds);
+
+  double q1 = quantile(sorted, n, 0.25);
+  double q3 = quantile(sorted, n, 0.75);
+  double fence = 1.5 * (q3 - q1);
+  BenchSummary summary = {
+    sorted[0],
+    quantile(sorted, n, 0.5),
+    sorted[(95 * n + 99) / 100 - 1],
+    sorted[n - 1],
+    0
+  };
+
+  for (size_t i = 0; i < n; ++i) {
+    if (sorted[i] < q1 - fence || sorted[i] > q3 + fence)
+      ++summary.outliers;
+  }
+
+  return summary;
+}
+
+// Write seconds in the unit that keeps three significant digits readable
+static void format_duration(char* buf, size_t len, double seconds) {
+  if (seconds >= 1)
+    snprintf(buf, len, "%.3fs", seconds);
+  else if (seconds >= 0.001)
+    snprintf(buf, len, "%.2fms", seconds * 1e3);
+  else
+    snprintf(buf, len, "%.1fus", seconds * 1e6);
+}
+
+// Print one summary line of the human readable report
+static void print_bench_line(const char* label, const BenchSummary* summary) {
+  char min[32], median[32], p95[32], max[32];
+
+  format_duration(min, sizeof(min), summary->min);
+  format_duration(median, sizeof(median), summary->median);
+  format_duration(p95, sizeof(p95), summary->p95);
+  format_duration(max, sizeof(max), summary->max);
+
+  printf("  %-10s min %-10s median %-10s p95 %-10s max %s\n", label, min,
+         median, p95, max);
+}
+
+// Print a string as a JSON string literal
+static void print_json_string(const char* str) {
+  putchar('"');
+
+  for (; *str != '\0'; ++str) {
+    unsigned char c = *str;
+
+    if (c == '"' || c == '\\')
+      printf("\\%c", c);
+    else if (c < 0x20)
+      printf("\\u%04x", c);
+    else
+      putchar(c);
+  }
+
+  putchar('"');
+}
+
+// Print a summary as a JSON object
+static void print_json_summary(const char* key, const BenchSummary* summary) {
+  printf("\"%s\":{\"min\":%.9f,\"median\":%.9f,\"p95\":%.9f,\"max\":%.9f,"
+         "\"outliers\":%zu}", key, summary->min, summary->median, summary->p95,
+         summary->max, summary->outliers);
+}
+
+// Run a copy of the line once with its output thrown away. Returns the wall
+// clock time and the CPU time of its processes and of quash itself.
+static void run_bench_once(const CommandHolder* holders, double* wall,
+                           double* user, double* sys) {
+  CommandHolder* copy = copy_script(holders);
+  struct rusage children, self_start, self_end;
+  struct timespec start, end;
+  int last = 0;
+
+  if (copy == NULL) {
+    bench_interrupted = true;
+    return;
+  }
+
+  while (get_command_holder_type(copy[last + 1]) != EOC)
+    ++last;
+
+  // Like hyperfine, output would only measure the terminal
+  if (!(copy[last].flags & REDIRECT_OUT)) {
+    copy[last].flags = (copy[last].flags & ~REDIRECT_APPEND) | REDIRECT_OUT;
+    copy[last].redirect_out = "/dev/null";
+  }
+
+  memset(&children, 0, sizeof(children));
+  bench_usage = &children;
+
+  getrusage(RUSAGE_SELF, &self_start);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  run_script(copy);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  getrusage(RUSAGE_SELF, &self_end);
+
+  bench_usage = NULL;
+  free(copy);
+
+  timersub(&self_end.ru_utime, &self_start.ru_utime, &self_end.ru_utime);
+  timersub(&self_end.ru_stime, &self_start.ru_stime, &self_end.ru_stime);
+  add_usage(&children, &self_end);
+
+  *wall = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+  *user = children.ru_utime.tv_sec + children.ru_utime.tv_usec / 1e6;
+  *sys = children.ru_stime.tv_sec + children.ru_stime.tv_usec / 1e6;
+}
+
+// Read a count of runs
+static bool parse_count(const char* str, long* out) {
+  char* end;
+  long value = strtol(str, &end, 10);
+
+  if (end == str || *end != '\0' || value < 0 || value > 1000000)
+    return false;
+
+  *out = value;
+
+  return true;
+}
+
+// Warmup runs fill caches and are not counted. Each measured run goes
+// through run_script() like a typed line, so no wrapper process is added.
+void run_bench(CommandHolder* holders) {
+  char** args = holders[0].cmd.bench.args;
+  long runs = 10;
+  long warmup = 0;
+  bool json = false;
+  bool ok = true;
+  int i = 1;
+
+  for (; ok && args[i] != NULL && args[i][0] == '-'; ++i) {
+    if (strcmp(args[i], "--") == 0) {
+      ++i;
+      break;
+    }
+
+    if (strcmp(args[i], "-j") == 0)
+      json = true;
+    else if (strcmp(args[i], "-n") == 0 && args[i + 1] != NULL)
+      ok = parse_count(args[++i], &runs) && runs > 0;
+    else if (strcmp(args[i], "-w") == 0 && args[i + 1] != NULL)
+      ok = parse_count(args[++i], &warmup);
+    else
+      ok = false;
+  }
+
+  if (!ok || args[i] == NULL || (holders[0].flags & BACKGROUND)) {
+    fprintf(stderr, "bench: usage: bench [-n RUNS] [-w WARMUP] [-j] [--] "
+            "COMMAND, in the foreground\n");
+    return;
+  }
+
+  // Jobs show the line as it was typed, see run_timeout()
+  free(get_command_string());
+
+  holders[0].cmd = mk_generic_command(args + i);
+
+  char* cmd = stringify_script(holders);
+  size_t cmd_len = strlen(cmd);
+  double* wall = malloc(runs * sizeof(double));
+  double* cpu = malloc(runs * sizeof(double));
+  double user, sys;
+  long done = 0;
+
+  if (wall == NULL || cpu == NULL) {
+    fprintf(stderr, "bench: out of memory\n");
+    free(wall);
+    free(cpu);
+    return;
+  }
+
+  while (cmd_len > 0 && cmd[cmd_len - 1] == ' ')
+    cmd[--cmd_len] = '\0';
+
+  bench_interrupted = false;
+
+  for (long w = 0; w < warmup && !bench_interrupted; ++w)
+    run_bench_once(holders, &wall[0], &user, &sys);
+
+  for (; done < runs && !bench_interrupted; ++done) {
+    run_bench_once(holders, &wall[done], &user, &sys);
+    cpu[done] = user + sys;
+
+    if (json)
+      printf("{\"run\":%ld,\"wall\":%.9f,\"user\":%.9f,\"sys\":%.9f}\n",
+             done + 1, wall[done], user, sys);
+  }
+
+  // The run Ctrl-C ended is not counted
+  if (bench_interrupted && done > 0)
+    --done;
+
+  if (done == 0) {
+    fprintf(stderr, "bench: no run finished\n");
+  }
+  else {
+    BenchSummary wall_summary = summarize(wall, done);
+    BenchSummary cpu_summary = summarize(cpu, done);
+
+    if (json) {
+      printf("{\"command\":");
+      print_json_string(cmd);
+      printf(",\"runs\":%ld,\"warmup\":%ld,", done, warmup);
+      print_json_summary("wall", &wall_summary);
+      putchar(',');
+      print_json_summary("cpu", &cpu_summary);
+      printf("}\n");
+    }
+    else {
+      printf("Benchmark: %s\n", cmd);
+      printf("  %-10s %ld%s, %ld warmup\n", "Runs:", done,
+             bench_interrupted ? " (interrupted)" : "", warmup);
+      print_bench_line("Wall time:", &wall_summary);
+      print_bench_line("CPU time:", &cpu_summary);
+
+      if (wall_summary.outliers > 0)
+        printf("  %-10s %zu run%s more than 1.5 IQR beyond the quartiles of "
+               "wall time\n", "Outliers:", wall_summary.outliers,
+               (wall_summary.outliers == 1) ? "" : "s");
+    }
+  }
+
+  fflush(stdout);
+  free(wall);
+  free(cpu);
+}
+
+// Wait for running jobs to make room until every pending job has started
+void finish_pending_jobs() {
+  start_pending_jobs();
+
+  while (has_unstarted_job() && wait_for_any_job())
+    check_jobs_bg_status();
+}
+
+// How long jobs get to exit when quash does. False if QUASH_EXIT_GRACE is
+// unset and jobs are left running.
+static bool exit_grace(struct timespec* grace) {
+  const char* value = getenv("QUASH_EXIT_GRACE");
+
+  return value != NULL && *value != '\0' && parse_duration(value, grace);
+}
+
+// Cancel what has not started, then signal every job at once so their grace
+// periods run side by side. Waiting for the jobs one by one afterwards costs
+// nothing extra since all of them end by the same deadline.
+void shutdown_jobs() {
+  struct timespec grace;
+  Job* next;
+
+  if (!exit_grace(&grace)) {
+    finish_pending_jobs();
+    return;
+  }
+
+  check_jobs_bg_status();
+
+  for (Job* job = first_job(); job != NULL; job = next) {
+    next = next_job(job);
+
+    if (job->state != JOB_PENDING)
+      continue;
+
+    printf("Cancelled: \t");
+    print_pending_job(job->id, "-", job->cmd);
+    cancel_pending_job(job);
+    free(job->pending);
+    release_job(job);
+  }
+
+  // Jobs skipped because a job they waited for was cancelled
+  check_jobs_bg_status();
+
+  for (Job* job = first_job(); job != NULL; job = next_job(job)) {
+    if (job->state != JOB_DONE)
+      end_job(job, &grace);
+  }
+
+  for (Job* job = first_job(); job != NULL; job = next_job(job)) {
+    while (job->state != JOB_DONE && wait_for_any_job());
+  }
+
+  for (Job* job; (job = take_finished_job()) != NULL; ) {
+    print_job_ended(job->id, job->pids[job->num_pids - 1], job->cmd,
+                    job->status);
+    release_job(job);
+  }
+}
+
+// True if any command in the array is a builtin
+static bool has_builtin(CommandHolder* holders) {
+  for (int i = 0; get_command_holder_type(holders[i]) != EOC; ++i) {
+    if (get_command_holder_type(holders[i]) != GENERIC)
+      return true;
+  }
+
+  return false;
+}
+
+// Set while the last list of commands quash will run is executing
+static bool final_script = false;
+
+// True if a lone command can replace quash with exec. A utility only can if
+// its program exists.
+static bool execs_program(CommandHolder holder) {
+  switch (get_command_holder_type(holder)) {
+  case GENERIC:
+    return true;
+
+  case UTILITY:
+    return lookup_command_path(holder.cmd.utility.args[0]) != NULL;
+
+  default:
+    return false;
+  }
+}
+
+// True unless the command is a sleep that quash must not take over. While
+// quash sleeps it cannot start pending jobs, enforce limits or be
+// interrupted from the terminal without exiting, so then sleep gets a child.
+static bool can_sleep_in_quash(CommandHolder holder) {
+  return get_command_holder_type(holder) != UTILITY
+         || !utility_sleeps(holder.cmd.utility)
+         || (first_job() == NULL && !line_has_limits()
+             && !job_control_enabled());
+}
+
+// Run a list of commands
+void run_script(CommandHolder* holders) {
+  if (holders == NULL)
+    return;
+
+  // A job that wrote and exited since quash last slept left its output in the
+  // pipe. joblog has to see it, even from a child of quash.
+  drain_job_logs();
+  resolve_named_builtins(holders);
+
+  if (get_command_holder_type(holders[0]) == TIMEOUT) {
+    run_timeout(holders);
+    return;
+  }
+
+  if (get_command_holder_type(holders[0]) == BUDGET) {
+    run_budget(holders);
+    return;
+  }
+
+  if (get_command_holder_type(holders[0]) == TIME) {
+    run_time(holders);
+    return;
+  }
+
+  if (get_command_holder_type(holders[0]) == BENCH) {
+    run_bench(holders);
+    return;
+  }
+
+  // after and wait may name jobs that finished since the last command. They
+  // have to be looked at before they are reported and forgotten.
+  if (get_command_holder_type(holders[0]) == AFTER) {
+    reap_jobs();
+    run_after(holders);
+    check_jobs_bg_status();
+    return;
+  }
+
+  if (get_command_holder_type(holders[0]) == WAIT
+      && get_command_holder_type(holders[1]) == EOC) {
+    reap_jobs();
+    run_builtin_in_process(holders[0]);
+    return;
+  }
+
+  check_jobs_bg_status();
+  publish_job_table();
+  revalidate_command_path_cache();
+
+  if (get_command_holder_type(holders[0]) == EXIT && get_command_holder_type(holders[1]) == EOC) {
+    end_main_loop();
+    return;
+  }
+
+  // exec replaces quash and so does a program that is the very last command
+  if (get_command_holder_type(holders[1]) == EOC
+      && !(holders[0].flags & BACKGROUND)) {
+    if (get_command_holder_type(holders[0]) == EXEC) {
+      exec_in_place(holders[0], holders[0].cmd.exec.args + 1);
+      return;
+    }
+
+    // Pending jobs still need quash to start them, limits need quash to
+    // enforce them and running jobs may need quash to end them. A utility
+    // is replaced by its program too, so quash exits with its status.
+    if (execs_program(holders[0]) && final_script
+        && !has_unstarted_job() && !line_has_limits()
+        && (first_job() == NULL || getenv("QUASH_EXIT_GRACE") == NULL)) {
+      exec_in_place(holders[0], holders[0].cmd.generic.args);
+      return;
+    }
+  }
+
+  // A builtin on its own in the foreground does not need a process
+  if (get_command_holder_type(holders[0]) != GENERIC
+      && get_command_holder_type(holders[1]) == EOC
+      && !(holders[0].flags & BACKGROUND) && can_sleep_in_quash(holders[0])) {
+    run_builtin_in_process(holders[0]);
+    return;
+  }
+
+  if (!(holders[0].flags & BACKGROUND) && use_builtin_threads()
+      && has_builtin(holders)) {
+    run_pipeline_with_threads(holders);
+    return;
+  }
+
+  if (holders[0].flags & BACKGROUND) {
+    schedule_background_job(holders);
+    return;
+  }
+
+  begin_pipeline(false);
+  CommandType type;
+
+  // Run all commands in the `holder` array
+  for (int i = 0; (type = get_command_holder_type(holders[i])) != EOC; ++i)
+    create_process(holders[i], i);
+
+  wait_for_pipeline(true);
+}
+
+// Run a list of commands that is known to be the last one
+void run_final_script(CommandHolder* holders) {
+  final_script = true;
+  run_script(holders);
+  final_script = false;
 }
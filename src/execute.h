@@ -63,6 +63,21 @@ void check_jobs_bg_status();
  */
 void print_job(int job_id, pid_t pid, const char* cmd);
 
+/**
+ * @brief Print a job that quash ended when it exited
+ *
+ * @param job_id Job identifier number.
+ *
+ * @param pid Process id of a process belonging to this job.
+ *
+ * @param cmd String holding an aproximation of what the user typed in for the
+ * command.
+ *
+ * @param status Wait status of the job. It is shown as Completed if the job
+ * exited, Killed if it needed SIGKILL and Terminated otherwise.
+ */
+void print_job_ended(int job_id, pid_t pid, const char* cmd, int status);
+
 /**
  * @brief Print the start up of a background job to standard out
  *
@@ -77,6 +92,49 @@ void print_job(int job_id, pid_t pid, const char* cmd);
  */
 void print_job_bg_start(int job_id, pid_t pid, const char* cmd);
 
+/**
+ * @brief Print a background job that has not been started yet
+ *
+ * @param job_id Job identifier number.
+ *
+ * @param state Word shown in place of the PID, such as "Pending"
+ *
+ * @param cmd String holding an aproximation of what the user typed in for the
+ * command.
+ */
+void print_pending_job(int job_id, const char* state, const char* cmd);
+
+/**
+ * @brief Print that a background job waits for a free slot before it starts
+ *
+ * @param job_id Job identifier number.
+ *
+ * @param cmd String holding an aproximation of what the user typed in for the
+ * command.
+ */
+void print_job_bg_queued(int job_id, const char* cmd);
+
+/**
+ * @brief Print that a job created by after waits for other jobs to finish
+ *
+ * @param job_id Job identifier number.
+ *
+ * @param cmd String holding an aproximation of what the user typed in for the
+ * command.
+ */
+void print_job_bg_waiting(int job_id, const char* cmd);
+
+/**
+ * @brief Print that a job created by "after -s" never ran because a job it
+ * waited for failed
+ *
+ * @param job_id Job identifier number.
+ *
+ * @param cmd String holding an aproximation of what the user typed in for the
+ * command.
+ */
+void print_job_skipped(int job_id, const char* cmd);
+
 /**
  * @brief Print the completion of a background job to standard out
  *
@@ -91,6 +149,33 @@ void print_job_bg_start(int job_id, pid_t pid, const char* cmd);
  */
 void print_job_bg_complete(int job_id, pid_t pid, const char* cmd);
 
+/**
+ * @brief Print that a job was stopped and moved to the background
+ *
+ * @param job_id Job identifier number.
+ *
+ * @param pid Process id of a process belonging to this job.
+ *
+ * @param cmd String holding an aproximation of what the user typed in for the
+ * command.
+ */
+void print_job_stopped(int job_id, pid_t pid, const char* cmd);
+
+/**
+ * @brief Print a job that went over its budget
+ *
+ * @param job_id Job identifier number.
+ *
+ * @param pid Process id of a process belonging to this job.
+ *
+ * @param cmd String holding an aproximation of what the user typed in for the
+ * command.
+ *
+ * @param budget Name of the budget, "CPU" or "memory"
+ */
+void print_job_over_budget(int job_id, pid_t pid, const char* cmd,
+                           const char* budget);
+
 /**
  * @brief Run a generic (non-builtin) command
  *
@@ -136,6 +221,156 @@ void run_cd(CDCommand cmd);
  */
 void run_kill(KillCommand cmd);
 
+/**
+ * @brief Run the builtin fg command. The job is continued if it is stopped,
+ * given the terminal and waited for.
+ *
+ * @param cmd A @a FGCommand
+ *
+ * @sa FGCommand
+ */
+void run_fg(FGCommand cmd);
+
+/**
+ * @brief Run the builtin bg command which continues a stopped job in the
+ * background
+ *
+ * @param cmd A @a BGCommand
+ *
+ * @sa BGCommand
+ */
+void run_bg(BGCommand cmd);
+
+/**
+ * @brief Run the builtin wait command
+ *
+ * Without arguments every background job is waited for, including pending
+ * ones. "-n" waits for the next job to finish, and "%N" or a pid waits for
+ * that job. A job that stops also ends the wait. Finished jobs are reported
+ * and, unless every job was waited for, the exit status of the last job is
+ * printed.
+ *
+ * @param cmd A @a WaitCommand
+ *
+ * @sa WaitCommand
+ */
+void run_wait(WaitCommand cmd);
+
+/**
+ * @brief Run the builtin timeout command
+ *
+ * The rest of the command line, including any further pipeline stages,
+ * redirects and '&', runs as usual. The job it becomes gets SIGTERM once the
+ * duration has passed, and SIGKILL too if "-k" gave a second duration that
+ * has passed after that. A queued job only starts its clock once it runs.
+ *
+ * @param holders An array of command holders whose first command is a @a
+ * TimeoutCommand
+ *
+ * @sa TimeoutCommand, JobTimeout
+ */
+void run_timeout(CommandHolder* holders);
+
+/**
+ * @brief Run the builtin budget command
+ *
+ * "-c" limits the CPU time and "-m" the resident memory of a job. A job over
+ * its budget is stopped, or killed with "-k". If the options are followed by
+ * a job as "%N" that job gets the budget, replacing any it had. Otherwise the
+ * rest of the command line runs as usual and the job it becomes gets the
+ * budget. QUASH_BUDGET_INTERVAL sets how often budgets are checked.
+ *
+ * @param holders An array of command holders whose first command is a @a
+ * BudgetCommand
+ *
+ * @sa BudgetCommand, JobBudget
+ */
+void run_budget(CommandHolder* holders);
+
+/**
+ * @brief Run the builtin time command
+ *
+ * The rest of the command line runs as usual. Once its foreground job is
+ * done, a table goes to standard error with a row per process: wall clock
+ * time, user and system CPU time, peak resident memory, major and minor page
+ * faults, and voluntary and involuntary context switches. A last row sums
+ * them up. The figures come from the wait4() call that reaps each process. A
+ * line that starts no process reports what quash used while running it.
+ *
+ * @param holders An array of command holders whose first command is a @a
+ * TimeCommand
+ *
+ * @sa TimeCommand, ProcessUsage
+ */
+void run_time(CommandHolder* holders);
+
+/**
+ * @brief Run the builtin bench command
+ *
+ * Runs the rest of the command line "-w" times to warm up and then "-n"
+ * times, 10 by default, through the same path as a typed line. Its standard
+ * out goes to /dev/null unless the line redirects it. Prints the minimum,
+ * median, 95th percentile and maximum of the wall clock time and of the CPU
+ * time of each run, and how many runs were outliers. With "-j" it prints a
+ * JSON object per run and one for the summary instead. Ctrl-C stops early
+ * and reports the runs that finished.
+ *
+ * @param holders An array of command holders whose first command is a @a
+ * BenchCommand
+ *
+ * @sa BenchCommand, run_time()
+ */
+void run_bench(CommandHolder* holders);
+
+/**
+ * @brief Run the builtin joblog command
+ *
+ * Prints what a background job wrote while QUASH_JOBLOG_SIZE was set. With
+ * "-f", and only when it runs inside quash rather than in a pipeline, it keeps
+ * printing new output until every process of the job has closed it.
+ *
+ * @param cmd A @a JoblogCommand
+ *
+ * @sa JoblogCommand
+ */
+void run_joblog(JoblogCommand cmd);
+
+/**
+ * @brief Run the builtin after command
+ *
+ * The rest of the command line, including any further pipeline stages and
+ * redirects, becomes a background job that starts once every job named by
+ * the arguments has finished. With "-s" it only starts if all of them exited
+ * with status 0.
+ *
+ * @param holders An array of command holders whose first command is an @a
+ * AfterCommand
+ *
+ * @sa AfterCommand
+ */
+void run_after(CommandHolder* holders);
+
+/**
+ * @brief Run the part of the builtin hash command that prints the program
+ * location cache
+ *
+ * @param cmd A @a HashCommand
+ *
+ * @sa HashCommand
+ */
+void run_hash(HashCommand cmd);
+
+/**
+ * @brief Run the part of the builtin hash command that changes the program
+ * location cache. "hash NAME..." looks up and remembers each NAME and "hash -r"
+ * forgets everything.
+ *
+ * @param cmd A @a HashCommand
+ *
+ * @sa HashCommand
+ */
+void run_hash_update(HashCommand cmd);
+
 /**
  * @brief Run the builtin pwd (print working directory) command
  *
@@ -146,9 +381,16 @@ void run_pwd();
 /**
  * @brief Run the builtin jobs command to show the jobs list
  *
- * @sa PWDCommand
+ * With "-v" every job is followed by a line per process with its state, CPU
+ * time, resident memory and the bytes it read and wrote. All processes are
+ * sampled in one pass over /proc and the samples are reused until the next
+ * command line.
+ *
+ * @param cmd A @a JobsCommand
+ *
+ * @sa JobsCommand
  */
-void run_jobs();
+void run_jobs(JobsCommand cmd);
 
 /**
  * @brief Common entry point for all commands
@@ -162,4 +404,38 @@ void run_jobs();
  */
 void run_script(CommandHolder* holders);
 
+/**
+ * @brief Start every pending background job before quash exits
+ *
+ * Blocks until enough running jobs have finished to start the last pending
+ * one, including jobs that wait for other jobs. Jobs that finish meanwhile
+ * are reported.
+ */
+void finish_pending_jobs();
+
+/**
+ * @brief Deal with the background jobs that are left when quash exits
+ *
+ * Without QUASH_EXIT_GRACE this is finish_pending_jobs() and running jobs are
+ * left alone. With it, jobs that have not started are cancelled and every
+ * other job gets SIGHUP and SIGTERM. Jobs still alive once the grace period
+ * has passed get SIGKILL. Quash waits for all of them and reports each one as
+ * cancelled, terminated or killed, so exiting takes at most about the grace
+ * period.
+ */
+void shutdown_jobs();
+
+/**
+ * @brief Run the last list of commands quash will ever see
+ *
+ * A single foreground program replaces quash with exec instead of being forked
+ * and waited for, so its exit status becomes quash's. Anything else is run
+ * with run_script().
+ *
+ * @param holders An array of command holders
+ *
+ * @sa run_script()
+ */
+void run_final_script(CommandHolder* holders);
+
 #endif
@@ -0,0 +1,238 @@
+/**
+ * @file job_log.c
+ *
+ * @brief Implements the ring buffers that hold the output of background jobs
+ */
+
+#define _GNU_SOURCE
+
+#include "job_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "event_loop.h"
+
+// Most bytes taken from one pipe per call of the handler. The loop calls it
+// again while more is waiting, so a job that never stops writing cannot keep
+// quash from everything else.
+#define DRAIN_LIMIT (64 * 1024)
+
+/**
+ * @brief Output of one job
+ *
+ * Nothing is ever moved around. The byte at position `pos` lives at
+ * `data[pos & (cap - 1)]` until `written` has gone `cap` bytes past it.
+ */
+typedef struct JobLog {
+  char* data;       /**< The ring */
+  size_t cap;       /**< Size of @a data, a power of two */
+  uint64_t written; /**< Bytes the job has written in total */
+  int fd;           /**< Read end of the pipe or -1 once it is closed */
+} JobLog;
+
+// Logs indexed by job id
+static JobLog** logs = NULL;
+static size_t num_log_slots = 0;
+
+// Builtin threads read logs while quash may be draining them
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Stop draining a log and close its pipe
+static void __close_log(JobLog* log) {
+  if (log->fd < 0)
+    return;
+
+  unwatch_fd(log->fd);
+  close(log->fd);
+  log->fd = -1;
+}
+
+// Reads until the pipe is empty or DRAIN_LIMIT is reached, appending to the
+// ring and overwriting its oldest bytes. The caller holds log_lock.
+static void __drain_locked(JobLog* log) {
+  size_t total = 0;
+
+  while (total < DRAIN_LIMIT && log->fd >= 0) {
+    size_t at = log->written & (log->cap - 1);
+    ssize_t n = read(log->fd, log->data + at, log->cap - at);
+
+    if (n > 0) {
+      log->written += n;
+      total += n;
+    }
+    else if (n == 0) {
+      __close_log(log);
+      break;
+    }
+    else if (errno != EINTR) {
+      break;
+    }
+  }
+}
+
+// Called by the event loop when the pipe of a log is readable
+static void __drain(int fd, void* data) {
+  (void) fd;
+
+  pthread_mutex_lock(&log_lock);
+  __drain_locked(data);
+  pthread_mutex_unlock(&log_lock);
+}
+
+// The log kept under an id or NULL
+static JobLog* __find(int job_id) {
+  if (job_id <= 0 || (size_t) job_id >= num_log_slots)
+    return NULL;
+
+  return logs[job_id];
+}
+
+// Take a log out of the table and free it
+static void __free_log(int job_id) {
+  JobLog* log = __find(job_id);
+
+  if (log == NULL)
+    return;
+
+  __close_log(log);
+  free(log->data);
+  free(log);
+  logs[job_id] = NULL;
+}
+
+bool start_job_log(int job_id, int fd, size_t size) {
+  JobLog* log = NULL;
+  size_t cap = 1;
+
+  while (cap < size)
+    cap *= 2;
+
+  pthread_mutex_lock(&log_lock);
+  __free_log(job_id);
+
+  if (job_id > 0 && (size_t) job_id >= num_log_slots) {
+    size_t slots = (num_log_slots == 0) ? 16 : num_log_slots;
+
+    while (slots <= (size_t) job_id)
+      slots *= 2;
+
+    JobLog** grown = realloc(logs, slots * sizeof(JobLog*));
+
+    if (grown != NULL) {
+      memset(grown + num_log_slots, 0,
+             (slots - num_log_slots) * sizeof(JobLog*));
+      logs = grown;
+      num_log_slots = slots;
+    }
+  }
+
+  if (job_id > 0 && (size_t) job_id < num_log_slots
+      && (log = malloc(sizeof(JobLog))) != NULL)
+    *log = (JobLog) { malloc(cap), cap, 0, fd };
+
+  if (log == NULL || log->data == NULL
+      || fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0
+      || !watch_fd(fd, __drain, log)) {
+    if (log != NULL)
+      free(log->data);
+
+    free(log);
+    close(fd);
+    pthread_mutex_unlock(&log_lock);
+    return false;
+  }
+
+  logs[job_id] = log;
+  pthread_mutex_unlock(&log_lock);
+
+  return true;
+}
+
+void drop_job_log(int job_id) {
+  pthread_mutex_lock(&log_lock);
+  __free_log(job_id);
+  pthread_mutex_unlock(&log_lock);
+}
+
+bool has_job_log(int job_id) {
+  pthread_mutex_lock(&log_lock);
+  bool found = __find(job_id) != NULL;
+  pthread_mutex_unlock(&log_lock);
+
+  return found;
+}
+
+bool job_log_is_open(int job_id) {
+  pthread_mutex_lock(&log_lock);
+  JobLog* log = __find(job_id);
+  bool open = log != NULL && log->fd >= 0;
+  pthread_mutex_unlock(&log_lock);
+
+  return open;
+}
+
+// Copies at most up to the end of the ring at a time, so the oldest part may
+// take a second copy
+size_t read_job_log(int job_id, uint64_t* pos, char* buf, size_t len) {
+  size_t done = 0;
+
+  pthread_mutex_lock(&log_lock);
+
+  JobLog* log = __find(job_id);
+
+  if (log != NULL) {
+    uint64_t oldest = (log->written > log->cap) ? log->written - log->cap : 0;
+
+    if (*pos < oldest)
+      *pos = oldest;
+
+    while (done < len && *pos < log->written) {
+      size_t at = *pos & (log->cap - 1);
+      size_t n = log->cap - at;
+
+      if (n > log->written - *pos)
+        n = log->written - *pos;
+
+      if (n > len - done)
+        n = len - done;
+
+      memcpy(buf + done, log->data + at, n);
+      done += n;
+      *pos += n;
+    }
+  }
+
+  pthread_mutex_unlock(&log_lock);
+
+  return done;
+}
+
+void drain_job_logs() {
+  pthread_mutex_lock(&log_lock);
+
+  for (size_t id = 0; id < num_log_slots; ++id) {
+    if (logs[id] != NULL)
+      __drain_locked(logs[id]);
+  }
+
+  pthread_mutex_unlock(&log_lock);
+}
+
+void destroy_job_logs() {
+  pthread_mutex_lock(&log_lock);
+
+  for (size_t id = 0; id < num_log_slots; ++id)
+    __free_log(id);
+
+  free(logs);
+  logs = NULL;
+  num_log_slots = 0;
+
+  pthread_mutex_unlock(&log_lock);
+}
@@ -0,0 +1,105 @@
+/**
+ * @file job_log.h
+ *
+ * @brief Keeps the output of background jobs in bounded ring buffers
+ *
+ * When QUASH_JOBLOG_SIZE is set, standard out and standard error of a
+ * background job go into a pipe instead of the terminal. Quash drains the pipe
+ * from its event loop into a ring buffer of that size, so the job never blocks
+ * on its output and a chatty job costs no more memory than its buffer. Once
+ * the buffer is full the oldest output is overwritten.
+ *
+ * Logs are kept by job id. The log of a finished job stays readable until a
+ * new job is started under the same id.
+ */
+
+#ifndef SRC_JOB_LOG_H
+#define SRC_JOB_LOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Largest log a job may have, 1G. A larger QUASH_JOBLOG_SIZE is
+ * ignored.
+ */
+#define JOB_LOG_MAX ((size_t) 1 << 30)
+
+/**
+ * @brief Start filling the log of a job from a pipe
+ *
+ * Any older log kept under the same id is dropped.
+ *
+ * @param job_id Job identifier number
+ *
+ * @param fd Read end of the pipe the job writes to. The log owns it from now
+ * on and closes it once every writer is gone.
+ *
+ * @param size Number of bytes kept, at most @a JOB_LOG_MAX. It is rounded up
+ * to a power of two.
+ *
+ * @return True on success. Otherwise @a fd is closed and nothing is kept.
+ */
+bool start_job_log(int job_id, int fd, size_t size);
+
+/**
+ * @brief Forget the log kept under a job id
+ *
+ * @param job_id Job identifier number
+ */
+void drop_job_log(int job_id);
+
+/**
+ * @brief Check whether a log is kept for a job id
+ *
+ * @param job_id Job identifier number
+ *
+ * @return True if start_job_log() was called for the id and the log was not
+ * dropped since
+ */
+bool has_job_log(int job_id);
+
+/**
+ * @brief Check whether the job may still add to its log
+ *
+ * @param job_id Job identifier number
+ *
+ * @return True while some process of the job holds the pipe open
+ */
+bool job_log_is_open(int job_id);
+
+/**
+ * @brief Copy output out of a log
+ *
+ * Positions count every byte the job has written. A position that was
+ * already overwritten is moved up to the oldest byte still kept, so a caller
+ * can tell how much was lost by how far it moved. Safe to call from builtin
+ * threads.
+ *
+ * @param job_id Job identifier number
+ *
+ * @param pos Position to read from. It is moved past the bytes returned.
+ *
+ * @param buf Where to copy the bytes
+ *
+ * @param len Size of @a buf
+ *
+ * @return Number of bytes copied. 0 if there is nothing new or no log.
+ */
+size_t read_job_log(int job_id, uint64_t* pos, char* buf, size_t len);
+
+/**
+ * @brief Read whatever is waiting in the pipes of all open logs
+ *
+ * The event loop only drains a pipe while quash sleeps. This catches up
+ * without waiting.
+ */
+void drain_job_logs();
+
+/**
+ * @brief Close every log and release its memory
+ */
+void destroy_job_logs();
+
+#endif
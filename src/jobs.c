@@ -0,0 +1,1468 @@
+/**
+ * @file jobs.c
+ *
+ * @brief Implements the job table, its indices and the reaper
+ */
+
+#include "jobs.h"
+
+#include "event_loop.h"
+#include "proc_stats.h"
+#include "shm_jobs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// Number of jobs allocated together
+#define SLAB_CHUNK 64
+
+// Size and alignment of an arena block. Strings and pid arrays are carved
+// out of blocks this size so a job does not cost a malloc() per field.
+#define ARENA_BLOCK (64 * 1024)
+
+/**
+ * @brief Open addressing hash table from a positive integer to a @a Job
+ *
+ * Key 0 marks a free slot. Removal shifts the following entries back so no
+ * tombstones are needed.
+ */
+typedef struct JobIndex {
+  int* keys;   /**< Pid or job id of each slot, 0 if free */
+  Job** jobs;  /**< Job of each used slot */
+  size_t* stages; /**< Position of each pid in the pids of its job */
+  size_t cap;  /**< Number of slots, always a power of two */
+  size_t len;  /**< Number of used slots */
+} JobIndex;
+
+/**
+ * @brief A block of job slots. Blocks are never freed while quash runs so a
+ * Job pointer stays valid until release_job().
+ */
+typedef struct JobChunk {
+  Job jobs[SLAB_CHUNK];  /**< The slots */
+  struct JobChunk* next; /**< The block allocated before this one */
+} JobChunk;
+
+static JobChunk* chunks = NULL;
+static Job* free_jobs = NULL;
+
+/**
+ * @brief Ties between a job created by after and the jobs it waits for
+ *
+ * Each tie is recorded on both ends, so a job that finishes finds the jobs
+ * waiting for it and a cancelled job finds the jobs it waited for.
+ */
+typedef struct JobLinks {
+  Job** waits_for;       /**< Jobs this job waits for. Entries are cleared as
+                          * those jobs finish. */
+  size_t num_waits_for;  /**< Number of entries in @a waits_for */
+  size_t unfinished;     /**< Entries of @a waits_for that are not cleared */
+  bool only_on_success;  /**< Skip this job if one it waits for failed */
+  bool failed;           /**< A job it waited for did not exit with 0 */
+  Job** dependents;      /**< Jobs that wait for this job */
+  size_t num_dependents; /**< Number of entries in @a dependents */
+  size_t cap_dependents; /**< Allocated entries of @a dependents */
+} JobLinks;
+
+/**
+ * @brief Header of an arena block. The allocations follow it.
+ *
+ * A block is freed once everything allocated from it has been released.
+ * Jobs started together usually end together, so blocks empty out quickly.
+ */
+typedef struct ArenaBlock {
+  size_t used; /**< Bytes handed out including the header */
+  size_t live; /**< Number of allocations not released yet */
+} ArenaBlock;
+
+// The block new allocations come from
+static ArenaBlock* arena = NULL;
+
+static JobIndex by_pid = { NULL, NULL, NULL, 0, 0 };
+
+// Job ids in use, one bit each, and the job of every id. Ids are handed out
+// lowest first so they stay as small as the number of jobs.
+static uint64_t* id_bits = NULL;
+static Job** id_jobs = NULL;
+static size_t id_words = 0;
+
+// No word below this one has a free bit
+static size_t id_hint = 0;
+
+// Background jobs that finished but were not reported yet, oldest first
+static Job* first_finished = NULL;
+static Job* last_finished = NULL;
+
+// Background jobs waiting for a slot, oldest first
+static Job* first_pending = NULL;
+static Job* last_pending = NULL;
+
+// Background jobs in JOB_RUNNING
+static size_t num_running = 0;
+
+// Bumped by every change the jobs builtin could show
+static uint64_t table_version = 0;
+
+// Pending jobs that still wait for other jobs
+static size_t num_waiting = 0;
+
+// Jobs whose time limit is running, a binary min-heap ordered by deadline
+static Job** timers = NULL;
+static size_t num_timers = 0;
+static size_t cap_timers = 0;
+
+// Jobs with a budget in no particular order, how often they are sampled and
+// when that happens next
+static Job** budgeted = NULL;
+static size_t num_budgeted = 0;
+static size_t cap_budgeted = 0;
+static struct timespec budget_interval = { 1, 0 };
+static struct timespec next_sample = { 0, 0 };
+
+// Terminal job control of an interactive quash
+static bool job_control = false;
+static struct termios shell_modes;
+
+/***************************************************************************
+ * Indices
+ ***************************************************************************/
+// Multiplicative hash spreading consecutive pids over the table
+static size_t __hash(int key, size_t cap) {
+  return ((unsigned) key * 2654435761u) & (cap - 1);
+}
+
+// Find the slot holding key or the free slot where it belongs
+static size_t __index_slot(const JobIndex* idx, int key) {
+  size_t i = __hash(key, idx->cap);
+
+  while (idx->keys[i] != 0 && idx->keys[i] != key)
+    i = (i + 1) & (idx->cap - 1);
+
+  return i;
+}
+
+static void __index_put(JobIndex* idx, int key, Job* job, size_t stage);
+
+// Double the number of slots and reinsert everything
+static void __index_grow(JobIndex* idx) {
+  JobIndex old = *idx;
+
+  idx->cap = (old.cap == 0) ? 64 : old.cap * 2;
+  idx->len = 0;
+  idx->keys = calloc(idx->cap, sizeof(int));
+  idx->jobs = calloc(idx->cap, sizeof(Job*));
+  idx->stages = calloc(idx->cap, sizeof(size_t));
+
+  if (idx->keys == NULL || idx->jobs == NULL || idx->stages == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate job index\n");
+    exit(-1);
+  }
+
+  for (size_t i = 0; i < old.cap; ++i) {
+    if (old.keys[i] != 0)
+      __index_put(idx, old.keys[i], old.jobs[i], old.stages[i]);
+  }
+
+  free(old.keys);
+  free(old.jobs);
+  free(old.stages);
+}
+
+static void __index_put(JobIndex* idx, int key, Job* job, size_t stage) {
+  if ((idx->len + 1) * 2 > idx->cap)
+    __index_grow(idx);
+
+  size_t i = __index_slot(idx, key);
+
+  if (idx->keys[i] == 0)
+    ++idx->len;
+
+  idx->keys[i] = key;
+  idx->jobs[i] = job;
+  idx->stages[i] = stage;
+}
+
+// The stage of key goes to stage unless it is NULL or key is missing
+static Job* __index_get(const JobIndex* idx, int key, size_t* stage) {
+  if (idx->cap == 0 || key <= 0)
+    return NULL;
+
+  size_t i = __index_slot(idx, key);
+
+  if (idx->keys[i] != key)
+    return NULL;
+
+  if (stage != NULL)
+    *stage = idx->stages[i];
+
+  return idx->jobs[i];
+}
+
+// Remove key and move later members of its probe chain back into the hole
+static void __index_remove(JobIndex* idx, int key) {
+  if (idx->cap == 0 || key <= 0)
+    return;
+
+  size_t mask = idx->cap - 1;
+  size_t hole = __index_slot(idx, key);
+
+  if (idx->keys[hole] != key)
+    return;
+
+  for (size_t i = (hole + 1) & mask; idx->keys[i] != 0; i = (i + 1) & mask) {
+    size_t home = __hash(idx->keys[i], idx->cap);
+
+    // Entries whose home lies cyclically in (hole, i] stay where they are
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      idx->keys[hole] = idx->keys[i];
+      idx->jobs[hole] = idx->jobs[i];
+      idx->stages[hole] = idx->stages[i];
+      hole = i;
+    }
+  }
+
+  idx->keys[hole] = 0;
+  idx->jobs[hole] = NULL;
+  --idx->len;
+}
+
+static void __index_destroy(JobIndex* idx) {
+  free(idx->keys);
+  free(idx->jobs);
+  free(idx->stages);
+  *idx = (JobIndex) { NULL, NULL, NULL, 0, 0 };
+}
+
+/***************************************************************************
+ * Arena
+ ***************************************************************************/
+// Header size rounded so allocations stay aligned for pid arrays
+#define ARENA_HEADER ((sizeof(ArenaBlock) + 7) & ~(size_t) 7)
+
+// Allocate a block of `size` bytes aligned to ARENA_BLOCK, so the block of
+// any allocation can be found by masking its address
+static ArenaBlock* __new_block(size_t size) {
+  size = (size + ARENA_BLOCK - 1) & ~(size_t) (ARENA_BLOCK - 1);
+
+  ArenaBlock* block = aligned_alloc(ARENA_BLOCK, size);
+
+  if (block == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate job arena\n");
+    exit(-1);
+  }
+
+  block->used = ARENA_HEADER;
+  block->live = 0;
+
+  return block;
+}
+
+// Carve `size` bytes out of the current block. Large requests get a block of
+// their own which is freed with its only allocation.
+static void* __arena_alloc(size_t size) {
+  ArenaBlock* block;
+
+  size = (size + 7) & ~(size_t) 7;
+
+  if (size > ARENA_BLOCK / 4) {
+    block = __new_block(ARENA_HEADER + size);
+  }
+  else {
+    if (arena != NULL && arena->used + size > ARENA_BLOCK) {
+      // A full block is freed by __arena_free() once it is empty
+      if (arena->live == 0)
+        free(arena);
+
+      arena = NULL;
+    }
+
+    if (arena == NULL)
+      arena = __new_block(ARENA_BLOCK);
+
+    block = arena;
+  }
+
+  void* ptr = (char*) block + block->used;
+
+  block->used += size;
+  ++block->live;
+
+  return ptr;
+}
+
+// Release an allocation made by __arena_alloc()
+static void __arena_free(void* ptr) {
+  if (ptr == NULL)
+    return;
+
+  ArenaBlock* block = (ArenaBlock*) ((uintptr_t) ptr & ~(uintptr_t) (ARENA_BLOCK - 1));
+
+  if (--block->live > 0)
+    return;
+
+  // The current block is simply reused from the start
+  if (block == arena)
+    block->used = ARENA_HEADER;
+  else
+    free(block);
+}
+
+// Copy a string into the arena
+static char* __arena_strdup(const char* str) {
+  size_t len = strlen(str) + 1;
+
+  return memcpy(__arena_alloc(len), str, len);
+}
+
+/***************************************************************************
+ * Job ids
+ ***************************************************************************/
+// Take the lowest free job id for a job
+static int __alloc_id(Job* job) {
+  size_t w = id_hint;
+
+  while (w < id_words && id_bits[w] == UINT64_MAX)
+    ++w;
+
+  if (w == id_words) {
+    size_t words = (id_words == 0) ? 4 : id_words * 2;
+    uint64_t* bits = realloc(id_bits, words * sizeof(uint64_t));
+    Job** jobs = (bits != NULL) ? realloc(id_jobs, words * 64 * sizeof(Job*))
+                                : NULL;
+
+    if (bits == NULL || jobs == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate job ids\n");
+      exit(-1);
+    }
+
+    memset(bits + id_words, 0, (words - id_words) * sizeof(uint64_t));
+    id_bits = bits;
+    id_jobs = jobs;
+    id_words = words;
+  }
+
+  int bit = __builtin_ctzll(~id_bits[w]);
+
+  ++table_version;
+
+  id_bits[w] |= (uint64_t) 1 << bit;
+  id_hint = w;
+  id_jobs[w * 64 + bit] = job;
+
+  return w * 64 + bit + 1;
+}
+
+// Give a job id back
+static void __free_id(int id) {
+  size_t w = (id - 1) / 64;
+
+  id_bits[w] &= ~((uint64_t) 1 << ((id - 1) % 64));
+
+  if (w < id_hint)
+    id_hint = w;
+}
+
+// True if the id belongs to a background job that is not done yet
+static bool __is_listed(size_t id) {
+  size_t w = (id - 1) / 64;
+
+  if (!(id_bits[w] & ((uint64_t) 1 << ((id - 1) % 64))))
+    return false;
+
+  Job* job = id_jobs[id - 1];
+
+  return job->background && job->state != JOB_DONE;
+}
+
+// The first listed job with an id of at least `id`. Whole words of free ids
+// are skipped at once.
+static Job* __listed_from(size_t id) {
+  while (id <= id_words * 64) {
+    uint64_t word = id_bits[(id - 1) / 64] >> ((id - 1) % 64);
+
+    if (word == 0) {
+      id = ((id - 1) / 64 + 1) * 64 + 1;
+      continue;
+    }
+
+    id += __builtin_ctzll(word);
+
+    if (__is_listed(id))
+      return id_jobs[id - 1];
+
+    ++id;
+  }
+
+  return NULL;
+}
+
+/***************************************************************************
+ * Job states
+ ***************************************************************************/
+// True if a job counts against the number of running background jobs
+static bool __takes_slot(const Job* job) {
+  return job->background && job->state == JOB_RUNNING;
+}
+
+static void __notify_dependents(Job* job);
+static void __remove_timer(Job* job);
+static void __remove_budgeted(Job* job);
+
+// Change the state of a job and keep num_running in step. Jobs waiting for it
+// hear about it once it is done and its time limit stops.
+static void __set_state(Job* job, JobState state) {
+  bool finished = state == JOB_DONE && job->state != JOB_DONE;
+
+  num_running -= __takes_slot(job);
+  job->state = state;
+  num_running += __takes_slot(job);
+  ++table_version;
+
+  if (finished) {
+    __remove_timer(job);
+    __remove_budgeted(job);
+    __notify_dependents(job);
+  }
+}
+
+// Change whether a job is a background job and keep num_running in step
+static void __set_background(Job* job, bool background) {
+  num_running -= __takes_slot(job);
+  job->background = background;
+  num_running += __takes_slot(job);
+  ++table_version;
+}
+
+// Append a job to a queue linked through Job.next
+static void __enqueue(Job** first, Job** last, Job* job) {
+  job->next = NULL;
+
+  if (*last != NULL)
+    (*last)->next = job;
+  else
+    *first = job;
+
+  *last = job;
+}
+
+// Take the oldest job off a queue linked through Job.next
+static Job* __dequeue(Job** first, Job** last) {
+  Job* job = *first;
+
+  if (job != NULL) {
+    *first = job->next;
+
+    if (*first == NULL)
+      *last = NULL;
+
+    job->next = NULL;
+  }
+
+  return job;
+}
+
+// Take a slot from the free list, adding a chunk if it is empty
+static Job* __alloc_job() {
+  if (free_jobs == NULL) {
+    JobChunk* chunk = malloc(sizeof(JobChunk));
+
+    if (chunk == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate job table\n");
+      exit(-1);
+    }
+
+    chunk->next = chunks;
+    chunks = chunk;
+
+    for (int i = SLAB_CHUNK - 1; i >= 0; --i) {
+      chunk->jobs[i].next = free_jobs;
+      free_jobs = &chunk->jobs[i];
+    }
+  }
+
+  Job* job = free_jobs;
+  free_jobs = job->next;
+
+  return job;
+}
+
+/***************************************************************************
+ * Dependencies
+ ***************************************************************************/
+// The links of a job, created on first use
+static JobLinks* __links(Job* job) {
+  if (job->links == NULL && (job->links = calloc(1, sizeof(JobLinks))) == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate job links\n");
+    exit(-1);
+  }
+
+  return job->links;
+}
+
+// True if a finished job ran and its last process exited with 0
+static bool __succeeded(const Job* job) {
+  return job->num_pids > 0 && WIFEXITED(job->status)
+         && WEXITSTATUS(job->status) == 0;
+}
+
+// Record that `job` waits for `dep` on the side of `dep`
+static void __add_dependent(Job* dep, Job* job) {
+  JobLinks* links = __links(dep);
+
+  if (links->num_dependents == links->cap_dependents) {
+    size_t cap = (links->cap_dependents == 0) ? 4 : links->cap_dependents * 2;
+    Job** dependents = realloc(links->dependents, cap * sizeof(Job*));
+
+    if (dependents == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate job links\n");
+      exit(-1);
+    }
+
+    links->dependents = dependents;
+    links->cap_dependents = cap;
+  }
+
+  links->dependents[links->num_dependents++] = job;
+}
+
+// Undo __add_dependent(). The order of dependents does not matter.
+static void __remove_dependent(Job* dep, Job* job) {
+  JobLinks* links = dep->links;
+
+  for (size_t i = 0; i < links->num_dependents; ++i) {
+    if (links->dependents[i] == job) {
+      links->dependents[i] = links->dependents[--links->num_dependents];
+      return;
+    }
+  }
+}
+
+// Every job a waiting job waited for is done. It either joins the pending
+// queue or is skipped and reported as finished.
+static void __dependencies_done(Job* job) {
+  --num_waiting;
+
+  if (job->links->only_on_success && job->links->failed) {
+    __enqueue(&first_finished, &last_finished, job);
+    __set_state(job, JOB_DONE);
+  }
+  else {
+    __enqueue(&first_pending, &last_pending, job);
+  }
+}
+
+// Tell the jobs waiting for a finished job about it
+static void __notify_dependents(Job* job) {
+  if (job->links == NULL || job->links->num_dependents == 0)
+    return;
+
+  // Skipped dependents notify their own dependents in turn, so the list is
+  // detached before any of that happens
+  Job** dependents = job->links->dependents;
+  size_t num_dependents = job->links->num_dependents;
+  bool ok = __succeeded(job);
+
+  job->links->dependents = NULL;
+  job->links->num_dependents = job->links->cap_dependents = 0;
+
+  for (size_t i = 0; i < num_dependents; ++i) {
+    JobLinks* links = dependents[i]->links;
+
+    for (size_t j = 0; j < links->num_waits_for; ++j) {
+      if (links->waits_for[j] == job)
+        links->waits_for[j] = NULL;
+    }
+
+    links->failed |= !ok;
+
+    if (--links->unfinished == 0)
+      __dependencies_done(dependents[i]);
+  }
+
+  free(dependents);
+}
+
+// Free the links of a job. Jobs on the other end must not point at it anymore.
+static void __free_links(Job* job) {
+  if (job->links == NULL)
+    return;
+
+  free(job->links->waits_for);
+  free(job->links->dependents);
+  free(job->links);
+  job->links = NULL;
+}
+
+/***************************************************************************
+ * Time limits
+ ***************************************************************************/
+// True if time a comes before time b
+static bool __before(const struct timespec* a, const struct timespec* b) {
+  return a->tv_sec < b->tv_sec
+         || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+// True if a duration is zero
+static bool __is_zero(const struct timespec* t) {
+  return t->tv_sec == 0 && t->tv_nsec == 0;
+}
+
+// Set t to `delay` from now
+static void __from_now(struct timespec* t, const struct timespec* delay) {
+  clock_gettime(CLOCK_MONOTONIC, t);
+  t->tv_sec += delay->tv_sec;
+  t->tv_nsec += delay->tv_nsec;
+
+  if (t->tv_nsec >= 1000000000L) {
+    t->tv_sec += 1;
+    t->tv_nsec -= 1000000000L;
+  }
+}
+
+// Put a job at a position of the heap and let it know where it is
+static void __timer_place(size_t i, Job* job) {
+  timers[i] = job;
+  job->timer = i + 1;
+}
+
+// Move the job at position i towards the root until its parent is due first
+static void __timer_sift_up(size_t i) {
+  Job* job = timers[i];
+
+  while (i > 0) {
+    size_t parent = (i - 1) / 2;
+
+    if (!__before(&job->deadline, &timers[parent]->deadline))
+      break;
+
+    __timer_place(i, timers[parent]);
+    i = parent;
+  }
+
+  __timer_place(i, job);
+}
+
+// Move the job at position i away from the root until no child is due first
+static void __timer_sift_down(size_t i) {
+  Job* job = timers[i];
+
+  for (;;) {
+    size_t child = 2 * i + 1;
+
+    if (child >= num_timers)
+      break;
+
+    if (child + 1 < num_timers
+        && __before(&timers[child + 1]->deadline, &timers[child]->deadline))
+      ++child;
+
+    if (!__before(&timers[child]->deadline, &job->deadline))
+      break;
+
+    __timer_place(i, timers[child]);
+    i = child;
+  }
+
+  __timer_place(i, job);
+}
+
+// Hand the earliest deadline to the event loop, whether that is a time limit
+// or the next budget sample
+static void __rearm_timer() {
+  const struct timespec* deadline = (num_timers > 0) ? &timers[0]->deadline
+                                                     : NULL;
+
+  if (num_budgeted > 0
+      && (deadline == NULL || __before(&next_sample, deadline)))
+    deadline = &next_sample;
+
+  set_event_timer(deadline);
+}
+
+// Make the next signal of a job due `delay` from now
+static void __add_timer(Job* job, const struct timespec* delay) {
+  if (num_timers == cap_timers) {
+    size_t cap = (cap_timers == 0) ? 16 : cap_timers * 2;
+    Job** grown = realloc(timers, cap * sizeof(Job*));
+
+    if (grown == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate job timers\n");
+      exit(-1);
+    }
+
+    timers = grown;
+    cap_timers = cap;
+  }
+
+  __from_now(&job->deadline, delay);
+
+  timers[num_timers] = job;
+  __timer_sift_up(num_timers++);
+
+  if (job->timer == 1)
+    __rearm_timer();
+}
+
+// Take a job out of the heap. The timerfd is left alone even if the job was
+// due first. Should it fire early, __expire_timers() finds nothing due and
+// sets it again, which is cheaper than a syscall for every job that finishes
+// in time.
+static void __remove_timer(Job* job) {
+  if (job->timer == 0)
+    return;
+
+  size_t i = job->timer - 1;
+  Job* last = timers[--num_timers];
+
+  job->timer = 0;
+
+  if (i < num_timers) {
+    __timer_place(i, last);
+    __timer_sift_up(i);
+    __timer_sift_down(last->timer - 1);
+  }
+}
+
+// Start the time limit of a job that just got its processes
+static void __start_timeout(Job* job) {
+  if (job->state == JOB_RUNNING && job->timer == 0 && !job->timed_out
+      && !__is_zero(&job->timeout.duration))
+    __add_timer(job, &job->timeout.duration);
+}
+
+/***************************************************************************
+ * Budgets
+ ***************************************************************************/
+// Start sampling a job. The first job with a budget starts the clock.
+static void __add_budgeted(Job* job) {
+  if (job->budget_slot != 0)
+    return;
+
+  if (num_budgeted == cap_budgeted) {
+    size_t cap = (cap_budgeted == 0) ? 16 : cap_budgeted * 2;
+    Job** grown = realloc(budgeted, cap * sizeof(Job*));
+
+    if (grown == NULL) {
+      fprintf(stderr, "ERROR: Failed to allocate job budgets\n");
+      exit(-1);
+    }
+
+    budgeted = grown;
+    cap_budgeted = cap;
+  }
+
+  budgeted[num_budgeted++] = job;
+  job->budget_slot = num_budgeted;
+
+  if (num_budgeted == 1) {
+    __from_now(&next_sample, &budget_interval);
+    __rearm_timer();
+  }
+}
+
+// Stop sampling a job. The last job in the list takes its place. As with
+// time limits the timerfd is left to fire once more for nothing.
+static void __remove_budgeted(Job* job) {
+  if (job->budget_slot == 0)
+    return;
+
+  Job* last = budgeted[--num_budgeted];
+
+  budgeted[job->budget_slot - 1] = last;
+  last->budget_slot = job->budget_slot;
+  job->budget_slot = 0;
+}
+
+// Sample every running job with a budget in one pass. A job over budget is
+// stopped or killed. A stopped job that is continued while still over budget
+// is stopped again by the next sample.
+static void __sample_budgets() {
+  static long ticks_per_sec = 0;
+  static long page_size = 0;
+
+  if (ticks_per_sec == 0) {
+    ticks_per_sec = sysconf(_SC_CLK_TCK);
+    page_size = sysconf(_SC_PAGESIZE);
+  }
+
+  for (size_t i = 0; i < num_budgeted; ++i) {
+    Job* job = budgeted[i];
+    unsigned long long ticks = 0;
+    size_t pages = 0;
+
+    if (job->state != JOB_RUNNING)
+      continue;
+
+    // /proc/PID/stat has both figures, so a sample costs a single read per
+    // process
+    for (size_t j = 0; j < job->num_pids; ++j) {
+      ProcStats stats;
+
+      if (find_job_by_pid(job->pids[j]) == job
+          && read_proc_stats(job->pids[j], &stats, false)) {
+        ticks += stats.ticks;
+        pages += stats.pages;
+      }
+    }
+
+    unsigned long long cpu_ticks = job->budget.cpu.tv_sec * ticks_per_sec
+      + job->budget.cpu.tv_nsec * ticks_per_sec / 1000000000L;
+
+    if (!__is_zero(&job->budget.cpu) && ticks > cpu_ticks)
+      job->over_budget = BUDGET_CPU;
+    else if (job->budget.rss > 0 && pages * page_size > job->budget.rss)
+      job->over_budget = BUDGET_MEMORY;
+    else
+      continue;
+
+    signal_job(job, job->budget.kill ? SIGKILL : SIGSTOP);
+  }
+}
+
+/***************************************************************************
+ * Deadlines
+ ***************************************************************************/
+// Signal every job whose deadline has passed. The first signal is SIGTERM.
+// A stopped job is continued so it sees it. With a kill delay the job goes
+// back in the heap and gets SIGKILL when that has passed as well. Budgets are
+// sampled when their interval is up.
+static void __expire_timers() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  while (num_timers > 0 && !__before(&now, &timers[0]->deadline)) {
+    Job* job = timers[0];
+
+    __remove_timer(job);
+
+    if (job->timed_out) {
+      signal_job(job, SIGKILL);
+      continue;
+    }
+
+    job->timed_out = true;
+    signal_job(job, SIGTERM);
+
+    if (job->state == JOB_STOPPED)
+      signal_job(job, SIGCONT);
+
+    if (!__is_zero(&job->timeout.kill_after))
+      __add_timer(job, &job->timeout.kill_after);
+  }
+
+  if (num_budgeted > 0 && !__before(&now, &next_sample)) {
+    __sample_budgets();
+    __from_now(&next_sample, &budget_interval);
+  }
+
+  __rearm_timer();
+}
+
+/***************************************************************************
+ * Job table
+ ***************************************************************************/
+// Hand a job its processes and index each of them
+static void __attach_pids(Job* job, const pid_t* pids, size_t num_pids,
+                          pid_t pgid) {
+  job->pgid = pgid;
+  job->pids = __arena_alloc((num_pids > 0 ? num_pids : 1) * sizeof(pid_t));
+  job->num_pids = job->live = num_pids;
+
+  memcpy(job->pids, pids, num_pids * sizeof(pid_t));
+
+  for (size_t i = 0; i < num_pids; ++i)
+    __index_put(&by_pid, pids[i], job, i);
+
+  if (num_pids > 0)
+    clock_gettime(CLOCK_REALTIME, &job->started);
+
+  __set_state(job, (num_pids > 0) ? JOB_RUNNING : JOB_DONE);
+  __start_timeout(job);
+}
+
+// Create a job and index each of its processes
+Job* new_job(const pid_t* pids, size_t num_pids, pid_t pgid, const char* cmd,
+             bool background) {
+  Job* job = __alloc_job();
+
+  *job = (Job) {
+    0,
+    0,
+    NULL,
+    0,
+    0,
+    0,
+    NULL,
+    0,
+    0,
+    JOB_DONE,
+    background,
+    { 0, 0 },
+    { 0, 0 },
+    (cmd != NULL) ? __arena_strdup(cmd) : NULL,
+    NULL,
+    NULL,
+    { { 0, 0 }, { 0, 0 } },
+    { 0, 0 },
+    0,
+    false,
+    { { 0, 0 }, 0, false },
+    0,
+    BUDGET_OK,
+    NULL,
+    NULL
+  };
+
+  __attach_pids(job, pids, num_pids, pgid);
+
+  if (background)
+    job->id = __alloc_id(job);
+
+  return job;
+}
+
+Job* new_pending_job(const char* cmd, void* pending) {
+  Job* job = new_job(NULL, 0, 0, cmd, true);
+
+  job->state = JOB_PENDING;
+  job->pending = pending;
+  __enqueue(&first_pending, &last_pending, job);
+
+  return job;
+}
+
+// The job counts as waiting until its last unfinished dependency is done. It
+// starts with one extra so that cannot happen before every tie is made.
+Job* new_dependent_job(const char* cmd, void* pending, Job* const* deps,
+                       size_t num_deps, bool only_on_success) {
+  Job* job = new_job(NULL, 0, 0, cmd, true);
+  JobLinks* links = __links(job);
+
+  job->state = JOB_PENDING;
+  job->pending = pending;
+
+  links->waits_for = malloc((num_deps > 0 ? num_deps : 1) * sizeof(Job*));
+  links->only_on_success = only_on_success;
+  links->unfinished = 1;
+  ++num_waiting;
+
+  if (links->waits_for == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate job links\n");
+    exit(-1);
+  }
+
+  for (size_t i = 0; i < num_deps; ++i) {
+    Job* dep = deps[i];
+    bool seen = false;
+
+    for (size_t j = 0; j < links->num_waits_for; ++j)
+      seen |= links->waits_for[j] == dep;
+
+    if (seen || dep == job)
+      continue;
+
+    if (dep->state == JOB_DONE) {
+      links->failed |= !__succeeded(dep);
+      continue;
+    }
+
+    links->waits_for[links->num_waits_for++] = dep;
+    ++links->unfinished;
+    __add_dependent(dep, job);
+  }
+
+  if (--links->unfinished == 0)
+    __dependencies_done(job);
+
+  return job;
+}
+
+bool job_is_waiting(const Job* job) {
+  return job->links != NULL && job->links->unfinished > 0;
+}
+
+Job* take_pending_job() {
+  return __dequeue(&first_pending, &last_pending);
+}
+
+// The pid array of the pending job is replaced. It held no pids.
+void start_pending_job(Job* job, const pid_t* pids, size_t num_pids,
+                       pid_t pgid) {
+  __arena_free(job->pids);
+  __attach_pids(job, pids, num_pids, pgid);
+  job->pending = NULL;
+}
+
+void set_job_timeout(Job* job, const JobTimeout* timeout) {
+  job->timeout = *timeout;
+  __start_timeout(job);
+}
+
+void set_job_budget(Job* job, const JobBudget* budget) {
+  job->budget = *budget;
+  job->over_budget = BUDGET_OK;
+
+  if (__is_zero(&budget->cpu) && budget->rss == 0)
+    __remove_budgeted(job);
+  else if (job->state != JOB_DONE)
+    __add_budgeted(job);
+}
+
+void set_budget_interval(const struct timespec* interval) {
+  if (!__is_zero(interval))
+    budget_interval = *interval;
+}
+
+// The job is marked as timed out so its next deadline means SIGKILL
+void end_job(Job* job, const struct timespec* grace) {
+  __remove_timer(job);
+  __remove_budgeted(job);
+
+  signal_job(job, SIGHUP);
+  signal_job(job, SIGTERM);
+
+  if (job->state == JOB_STOPPED)
+    signal_job(job, SIGCONT);
+
+  job->timed_out = true;
+  __add_timer(job, grace);
+}
+
+// A waiting job unties itself from the jobs it waits for. A queued one is
+// searched for in the queue. Cancelling is rare so it is not indexed.
+void cancel_pending_job(Job* job) {
+  if (job_is_waiting(job)) {
+    for (size_t i = 0; i < job->links->num_waits_for; ++i) {
+      if (job->links->waits_for[i] != NULL)
+        __remove_dependent(job->links->waits_for[i], job);
+    }
+
+    job->links->unfinished = 0;
+    --num_waiting;
+  }
+  else {
+    Job* prev = NULL;
+
+    for (Job* it = first_pending; it != NULL && it != job; it = it->next)
+      prev = it;
+
+    if (prev != NULL)
+      prev->next = job->next;
+    else if (first_pending == job)
+      first_pending = job->next;
+
+    if (last_pending == job)
+      last_pending = prev;
+
+    job->next = NULL;
+  }
+
+  __set_state(job, JOB_DONE);
+}
+
+bool has_pending_job() {
+  return first_pending != NULL;
+}
+
+bool has_unstarted_job() {
+  return first_pending != NULL || num_waiting > 0;
+}
+
+size_t running_job_count() {
+  return num_running;
+}
+
+// Drop a job from every index and put its slot back on the free list
+void release_job(Job* job) {
+  for (size_t i = 0; i < job->num_pids; ++i) {
+    if (__index_get(&by_pid, job->pids[i], NULL) == job)
+      __index_remove(&by_pid, job->pids[i]);
+  }
+
+  if (job->id > 0)
+    __free_id(job->id);
+
+  num_running -= __takes_slot(job);
+  ++table_version;
+
+  __remove_timer(job);
+  __remove_budgeted(job);
+  __arena_free(job->pids);
+  __free_links(job);
+  __arena_free(job->cmd);
+  free(job->stopped);
+  free(job->usage);
+
+  job->next = free_jobs;
+  free_jobs = job;
+}
+
+Job* find_job(int id) {
+  if (id <= 0 || (size_t) id > id_words * 64)
+    return NULL;
+
+  size_t w = (id - 1) / 64;
+
+  return (id_bits[w] & ((uint64_t) 1 << ((id - 1) % 64))) ? id_jobs[id - 1]
+                                                          : NULL;
+}
+
+Job* find_job_by_pid(pid_t pid) {
+  return __index_get(&by_pid, pid, NULL);
+}
+
+// Finished jobs are few, they only live until the next command
+Job* find_finished_job(pid_t pid) {
+  for (Job* job = first_finished; job != NULL; job = job->next) {
+    for (size_t i = 0; i < job->num_pids; ++i) {
+      if (job->pids[i] == pid)
+        return job;
+    }
+  }
+
+  return NULL;
+}
+
+Job* first_job() {
+  return __listed_from(1);
+}
+
+// Search down from the highest word that has any id in use
+Job* last_job() {
+  for (size_t id = id_words * 64; id > 0; --id) {
+    if (id % 64 == 0 && id_bits[(id - 1) / 64] == 0) {
+      id -= 63;
+      continue;
+    }
+
+    if (__is_listed(id))
+      return id_jobs[id - 1];
+  }
+
+  return NULL;
+}
+
+Job* next_job(const Job* job) {
+  return __listed_from(job->id + 1);
+}
+
+uint64_t job_table_version() {
+  return table_version;
+}
+
+/***************************************************************************
+ * Reaping
+ ***************************************************************************/
+bool record_job_usage(Job* job, const struct timespec* launched) {
+  job->launched = *launched;
+
+  if (job->usage == NULL && job->num_pids > 0)
+    job->usage = calloc(job->num_pids, sizeof(ProcessUsage));
+
+  return job->usage != NULL;
+}
+
+// Mark one process of a job as stopped or running. Returns false if nothing
+// changed. Only stops and continues pay for the search through the pids.
+static bool __set_stopped(Job* job, pid_t pid, bool stopped) {
+  size_t i = 0;
+
+  if (job->stopped == NULL) {
+    if (!stopped || (job->stopped = calloc(job->num_pids, sizeof(bool))) == NULL)
+      return false;
+  }
+
+  while (i < job->num_pids && job->pids[i] != pid)
+    ++i;
+
+  if (i == job->num_pids || job->stopped[i] == stopped)
+    return false;
+
+  job->stopped[i] = stopped;
+  job->num_stopped += stopped ? 1 : -1;
+
+  return true;
+}
+
+// Work out whether a job that still has live processes is running or stopped
+static void __update_state(Job* job) {
+  __set_state(job, (job->num_stopped == job->live) ? JOB_STOPPED : JOB_RUNNING);
+}
+
+// Record that a process was stopped by signal or continued if signal is 0
+static void __process_stopped(pid_t pid, int signal) {
+  Job* job = find_job_by_pid(pid);
+
+  if (job == NULL)
+    return;
+
+  if (signal != 0)
+    job->stop_signal = signal;
+
+  if (__set_stopped(job, pid, signal != 0))
+    __update_state(job);
+}
+
+// Keep what the process at stage of a job used
+static void __record_usage(Job* job, size_t stage,
+                           const struct rusage* rusage) {
+  job->usage[stage].rusage = *rusage;
+  job->usage[stage].reaped = true;
+  clock_gettime(CLOCK_MONOTONIC, &job->usage[stage].ended);
+}
+
+// Record that a process exited
+static void __process_exited(pid_t pid, int status,
+                             const struct rusage* rusage) {
+  size_t stage;
+  Job* job = __index_get(&by_pid, pid, &stage);
+
+  // Not one of ours. Helpers like the spawn zygote end up here.
+  if (job == NULL)
+    return;
+
+  if (job->num_stopped > 0)
+    __set_stopped(job, pid, false);
+
+  if (job->usage != NULL)
+    __record_usage(job, stage, rusage);
+
+  __index_remove(&by_pid, pid);
+
+  if (job->num_pids > 0 && job->pids[job->num_pids - 1] == pid)
+    job->status = status;
+
+  if (--job->live > 0) {
+    __update_state(job);
+    return;
+  }
+
+  // Queued first so the job is reported before any job skipped because of it
+  if (job->background)
+    __enqueue(&first_finished, &last_finished, job);
+
+  __set_state(job, JOB_DONE);
+}
+
+// Collect one state change of a child. Exits reap the child, stops and
+// continues are only recorded. wait4() hands over the resource usage of an
+// exited child in the same call. Returns false once no child is ready or none
+// are left.
+static bool __reap_one(bool block) {
+  int flags = WUNTRACED | WCONTINUED | (block ? 0 : WNOHANG);
+  struct rusage rusage;
+  int status;
+  pid_t pid = wait4(-1, &status, flags, &rusage);
+
+  if (pid < 0)
+    return errno == EINTR;
+
+  if (pid == 0)
+    return false;
+
+  if (WIFSTOPPED(status))
+    __process_stopped(pid, WSTOPSIG(status));
+  else if (WIFCONTINUED(status))
+    __process_stopped(pid, 0);
+  else
+    __process_exited(pid, status, &rusage);
+
+  return true;
+}
+
+// Block until a child changes state. While a time limit runs, a job has a
+// budget or a job log is being filled, quash sleeps in the event loop instead
+// of in wait4(), which neither the timer nor a pipe could interrupt. Without
+// a signalfd there is nothing to sleep on and limits are only enforced between
+// commands.
+static bool __reap_blocking() {
+  for (;;) {
+    if (take_timer_events())
+      __expire_timers();
+
+    publish_job_table();
+
+    if ((num_timers == 0 && num_budgeted == 0 && !has_watched_fds())
+        || child_signal_mask() == NULL)
+      return __reap_one(true);
+
+    errno = 0;
+
+    if (__reap_one(false))
+      return true;
+
+    if (errno != 0)
+      return false;
+
+    wait_for_child_event();
+  }
+}
+
+// Only look for children when a SIGCHLD says something happened
+void reap_jobs() {
+  if (take_timer_events())
+    __expire_timers();
+
+  if (take_child_events())
+    while (__reap_one(false));
+}
+
+int wait_for_job(Job* job) {
+  while (job->state == JOB_RUNNING) {
+    if (!__reap_blocking() && errno == ECHILD) {
+      // The processes are gone without us seeing them exit
+      job->live = 0;
+      __set_state(job, JOB_DONE);
+    }
+  }
+
+  return job->status;
+}
+
+bool wait_for_any_job() {
+  if (!__reap_blocking())
+    return errno != ECHILD;
+
+  while (__reap_one(false));
+
+  return true;
+}
+
+int signal_job(Job* job, int sig) {
+  if (job->pgid > 0)
+    return killpg(job->pgid, sig);
+
+  // Processes that were already reaped are skipped. Their pids may belong to
+  // somebody else by now.
+  for (size_t i = 0; i < job->num_pids; ++i) {
+    if (find_job_by_pid(job->pids[i]) == job && kill(job->pids[i], sig) < 0)
+      return -1;
+  }
+
+  return 0;
+}
+
+void resume_job(Job* job) {
+  if (job->stopped != NULL) {
+    for (size_t i = 0; i < job->num_pids; ++i)
+      job->stopped[i] = false;
+  }
+
+  job->num_stopped = 0;
+  __set_state(job, JOB_RUNNING);
+
+  signal_job(job, SIGCONT);
+}
+
+void move_job_to_background(Job* job, const char* cmd) {
+  if (job->background)
+    return;
+
+  if (job->id == 0)
+    job->id = __alloc_id(job);
+
+  if (job->cmd == NULL && cmd != NULL)
+    job->cmd = __arena_strdup(cmd);
+
+  __set_background(job, true);
+}
+
+void move_job_to_foreground(Job* job) {
+  __set_background(job, false);
+}
+
+Job* take_finished_job() {
+  return __dequeue(&first_finished, &last_finished);
+}
+
+bool has_finished_job() {
+  return first_finished != NULL;
+}
+
+/***************************************************************************
+ * Terminal
+ ***************************************************************************/
+void start_job_control() {
+  // Fails harmlessly when quash already leads a session
+  setpgid(0, 0);
+
+  job_control = tcsetpgrp(STDIN_FILENO, getpgrp()) == 0
+                && tcgetattr(STDIN_FILENO, &shell_modes) == 0;
+}
+
+bool job_control_enabled() {
+  return job_control;
+}
+
+void give_terminal_to(const Job* job) {
+  if (job_control && job->pgid > 0)
+    tcsetpgrp(STDIN_FILENO, job->pgid);
+}
+
+// The job may have changed the modes before it stopped or died
+void take_terminal_back() {
+  if (!job_control)
+    return;
+
+  tcsetpgrp(STDIN_FILENO, getpgrp());
+  tcsetattr(STDIN_FILENO, TCSADRAIN, &shell_modes);
+}
+
+// Free every job and the slab itself
+void destroy_jobs() {
+  for (Job* job; (job = take_finished_job()) != NULL; )
+    release_job(job);
+
+  for (Job* job; (job = take_pending_job()) != NULL; ) {
+    free(job->pending);
+    release_job(job);
+  }
+
+  for (size_t id = 1; id <= id_words * 64; ++id) {
+    Job* job = find_job(id);
+
+    if (job != NULL && job->state == JOB_PENDING)
+      free(job->pending);
+
+    if (job != NULL)
+      release_job(job);
+  }
+
+  // Only the current block can be left, and it is empty by now
+  free(arena);
+  arena = NULL;
+
+  while (chunks != NULL) {
+    JobChunk* next = chunks->next;
+
+    free(chunks);
+    chunks = next;
+  }
+
+  free_jobs = NULL;
+  __index_destroy(&by_pid);
+
+  free(timers);
+  timers = NULL;
+  num_timers = cap_timers = 0;
+
+  free(budgeted);
+  budgeted = NULL;
+  num_budgeted = cap_budgeted = 0;
+
+  free(id_bits);
+  free(id_jobs);
+  id_bits = NULL;
+  id_jobs = NULL;
+  id_words = id_hint = 0;
+}
@@ -0,0 +1,541 @@
+/**
+ * @file jobs.h
+ *
+ * @brief Keeps track of every pipeline quash has started and reaps its
+ * processes
+ *
+ * Jobs live in a slab of fixed size chunks so a @a Job never moves once it is
+ * created. Their pid arrays and command strings are carved out of a shared
+ * arena instead of being allocated one by one. A hash table indexes the pid
+ * of every process in a job, so handling the exit of one of its processes
+ * does not depend on how many jobs exist.
+ *
+ * Job ids are tracked in a bitmap and the lowest free id is always handed
+ * out, so ids stay as small as the number of jobs that exist at the same
+ * time. The bitmap also gives the job list in id order without keeping a
+ * sorted list.
+ *
+ * A background job can also be created pending, before any of its processes
+ * exist. Pending jobs get their job id right away and wait in a queue, oldest
+ * first, until the scheduler in execute.c finds a free slot for them. The
+ * number of running background jobs is kept up to date with every state
+ * change so checking for a slot costs nothing.
+ *
+ * A pending job may also wait for other jobs to finish first. Such a job is
+ * only put in the queue once the last of them is done. The ties are kept on
+ * both ends, so a finishing job wakes exactly the jobs that wait for it and
+ * nothing is polled.
+ *
+ * A job may carry a time limit. Its clock starts when its processes do.
+ * Running limits sit in a heap ordered by deadline and only the earliest one
+ * is handed to the timerfd of the event loop. When it fires the job gets
+ * SIGTERM and, if asked for, SIGKILL once a second delay has passed too.
+ *
+ * A job may also carry a budget of CPU time and resident memory. Every job
+ * with a budget is sampled in one pass from /proc/PID/stat each time the
+ * sampling interval passes. That deadline shares the timerfd with the time
+ * limits. A job over its budget is stopped, or killed if its budget says so.
+ *
+ * Background jobs, and every job of an interactive quash, run in a process
+ * group of their own led by their first process. Signalling such a job takes
+ * a single killpg() no matter how many processes it has.
+ */
+
+#ifndef SRC_JOBS_H
+#define SRC_JOBS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+/**
+ * @brief Lifecycle of a @a Job
+ */
+typedef enum JobState {
+  JOB_RUNNING = 0, /**< At least one process has not been reaped */
+  JOB_STOPPED,     /**< Every process that has not been reaped is stopped */
+  JOB_DONE,        /**< Every process has been reaped */
+  JOB_PENDING      /**< Waiting for a slot, no process has been started */
+} JobState;
+
+struct JobLinks;
+
+/**
+ * @brief Which budget a job went over
+ */
+typedef enum BudgetHit {
+  BUDGET_OK = 0, /**< The job stayed within its budget */
+  BUDGET_CPU,    /**< The job used more CPU time than allowed */
+  BUDGET_MEMORY  /**< The job had more resident memory than allowed */
+} BudgetHit;
+
+/**
+ * @brief Resources a job may use set by the budget builtin
+ *
+ * Only processes of the job that have not been reaped count. The CPU time of
+ * a process includes the children it waited for.
+ */
+typedef struct JobBudget {
+  struct timespec cpu; /**< CPU time of the job. Zero for no limit. */
+  size_t rss;          /**< Resident memory of the job in bytes. 0 for no
+                        * limit. */
+  bool kill;           /**< SIGKILL a job over budget instead of SIGSTOP */
+} JobBudget;
+
+/**
+ * @brief Time limit of a job set by the timeout builtin
+ */
+typedef struct JobTimeout {
+  struct timespec duration;   /**< How long the job may run before it gets
+                               * SIGTERM. Zero for no limit. */
+  struct timespec kill_after; /**< How long after SIGTERM the job gets
+                               * SIGKILL. Zero to never send it. */
+} JobTimeout;
+
+/**
+ * @brief Resources one process of a job used, recorded when it is reaped
+ */
+typedef struct ProcessUsage {
+  struct rusage rusage;  /**< As wait4() returned it, including the children
+                          * the process waited for */
+  struct timespec ended; /**< When it was reaped on CLOCK_MONOTONIC */
+  bool reaped;           /**< False while the process runs */
+} ProcessUsage;
+
+/**
+ * @brief A pipeline started by quash
+ */
+typedef struct Job {
+  int id;             /**< Job number shown to the user. Foreground jobs do
+                       * not get one and use 0. */
+  pid_t pgid;         /**< Process group of the job or 0 if its processes
+                       * share quash's group */
+  pid_t* pids;        /**< Processes of the pipeline in pipeline order */
+  size_t num_pids;    /**< Number of entries in @a pids */
+  size_t live;        /**< Number of processes that have not been reaped */
+  size_t num_stopped; /**< Number of live processes that are stopped */
+  bool* stopped;      /**< Which entries of @a pids are stopped. Allocated
+                       * the first time a process stops. */
+  int stop_signal;    /**< Signal that last stopped one of its processes, 0
+                       * if none has stopped */
+  int status;         /**< Wait status of the last process of the pipeline */
+  JobState state;     /**< Whether the job is still running */
+  bool background;    /**< True if the job was started with '&' */
+  struct timespec started; /**< When its processes were started on
+                            * CLOCK_REALTIME, zero until then. Only for the
+                            * shared job table, see @a launched for timing. */
+  struct timespec launched; /**< When quash began to start its processes on
+                             * CLOCK_MONOTONIC. Only set for jobs passed to
+                             * record_job_usage(). */
+  char* cmd;          /**< The command string for background jobs or NULL */
+  void* pending;      /**< What a pending job runs once it starts. Belongs to
+                       * the creator of the job. */
+  struct JobLinks* links; /**< Jobs this job waits for and jobs waiting for
+                           * it or NULL if there are none */
+  JobTimeout timeout; /**< Time limit of the job, zero if it has none */
+  struct timespec deadline; /**< When the next signal is due on
+                             * CLOCK_MONOTONIC while the limit runs */
+  size_t timer;       /**< Position in the heap of running limits plus one,
+                       * 0 if the job is not in it */
+  bool timed_out;     /**< The time limit ran out and SIGTERM was sent */
+  JobBudget budget;   /**< Resources the job may use, zero if unlimited */
+  size_t budget_slot; /**< Position in the list of jobs with a budget plus
+                       * one, 0 if the job is not in it */
+  BudgetHit over_budget; /**< The budget the job went over, if any */
+  ProcessUsage* usage; /**< Usage of each entry of @a pids or NULL unless
+                        * record_job_usage() was called */
+  struct Job* next;   /**< Links free slots, pending and finished jobs */
+} Job;
+
+/**
+ * @brief Create a job for processes that have just been started
+ *
+ * @param pids The processes of the pipeline in pipeline order. The array is
+ * copied.
+ *
+ * @param num_pids Number of entries in @a pids
+ *
+ * @param pgid Process group the processes were put in or 0 if they stayed in
+ * quash's group
+ *
+ * @param cmd The command string of a background job or NULL for a foreground
+ * job. The string is copied.
+ *
+ * @param background True if the job runs in the background and should get a
+ * job id
+ *
+ * @return The new job
+ */
+Job* new_job(const pid_t* pids, size_t num_pids, pid_t pgid, const char* cmd,
+             bool background);
+
+/**
+ * @brief Create a background job that runs later and queue it behind the
+ * other pending jobs
+ *
+ * @param cmd The command string of the job. The string is copied.
+ *
+ * @param pending What the job will run, stored in @a Job.pending
+ *
+ * @return The new job in state @a JOB_PENDING with a job id
+ */
+Job* new_pending_job(const char* cmd, void* pending);
+
+/**
+ * @brief Create a background job that runs once other jobs have finished
+ *
+ * The job is pending but only enters the queue when the last job it waits for
+ * is done. If @a only_on_success is set and any of them did not exit with
+ * status 0, the job never starts. It is reported through take_finished_job()
+ * with no processes instead.
+ *
+ * @param cmd The command string of the job. The string is copied.
+ *
+ * @param pending What the job will run, stored in @a Job.pending
+ *
+ * @param deps The jobs to wait for. Jobs that are already done only count
+ * for @a only_on_success.
+ *
+ * @param num_deps Number of entries in @a deps
+ *
+ * @param only_on_success True to skip the job unless every job in @a deps
+ * succeeded
+ *
+ * @return The new job in state @a JOB_PENDING with a job id
+ */
+Job* new_dependent_job(const char* cmd, void* pending, Job* const* deps,
+                       size_t num_deps, bool only_on_success);
+
+/**
+ * @brief Check whether a pending job still waits for other jobs
+ *
+ * @param job Any job
+ *
+ * @return True if the job waits for a job that is not done
+ */
+bool job_is_waiting(const Job* job);
+
+/**
+ * @brief Take the oldest pending job off the queue
+ *
+ * The job stays in state @a JOB_PENDING and listed until start_pending_job().
+ *
+ * @return The job or NULL if no job is pending
+ */
+Job* take_pending_job();
+
+/**
+ * @brief Give a job taken with take_pending_job() the processes that were
+ * started for it
+ *
+ * @param job The job
+ *
+ * @param pids The processes of the pipeline in pipeline order. The array is
+ * copied.
+ *
+ * @param num_pids Number of entries in @a pids. The job is done if it is 0.
+ *
+ * @param pgid Process group the processes were put in
+ */
+void start_pending_job(Job* job, const pid_t* pids, size_t num_pids,
+                       pid_t pgid);
+
+/**
+ * @brief Give a job a time limit
+ *
+ * The limit starts running right away if the job runs and otherwise once its
+ * processes are started. A limit of zero does nothing.
+ *
+ * @param job A job that is running or pending
+ *
+ * @param timeout The limit. It is copied.
+ */
+void set_job_timeout(Job* job, const JobTimeout* timeout);
+
+/**
+ * @brief Give a job a budget or replace the one it has
+ *
+ * Sampling starts right away. A job that went over its old budget counts as
+ * within budget again until the next sample.
+ *
+ * @param job A job that is not done
+ *
+ * @param budget The budget. It is copied. A budget of zero removes it.
+ */
+void set_job_budget(Job* job, const JobBudget* budget);
+
+/**
+ * @brief Set how often jobs with a budget are sampled
+ *
+ * @param interval Time between samples. Zero keeps the current interval,
+ * which starts out as one second.
+ */
+void set_budget_interval(const struct timespec* interval);
+
+/**
+ * @brief Keep the resource usage of each process of a job as it is reaped
+ *
+ * The reaper collects it with wait4() either way. This only gives it a place
+ * to go, which is freed with the job.
+ *
+ * @param job A job whose processes were started
+ *
+ * @param launched When quash began to start them on CLOCK_MONOTONIC. Times in
+ * the usage are measured from it.
+ *
+ * @return False if there was no memory for it
+ */
+bool record_job_usage(Job* job, const struct timespec* launched);
+
+/**
+ * @brief Ask a running or stopped job to end and make sure it does
+ *
+ * The job gets SIGHUP and SIGTERM right away, and SIGCONT if it is stopped.
+ * Any time limit or budget it had is dropped. If it is still alive once @a
+ * grace has passed it gets SIGKILL, enforced like a time limit.
+ *
+ * @param job A job that has processes and is not done
+ *
+ * @param grace How long the job has to exit on its own
+ */
+void end_job(Job* job, const struct timespec* grace);
+
+/**
+ * @brief Take a job out of the pending queue without starting it
+ *
+ * The job is done afterwards. Jobs waiting for it count it as failed. The
+ * caller releases the job.
+ *
+ * @param job A job in state @a JOB_PENDING, queued or waiting for other jobs
+ */
+void cancel_pending_job(Job* job);
+
+/**
+ * @brief Check whether any job waits in the pending queue
+ *
+ * @return True if take_pending_job() would return a job
+ */
+bool has_pending_job();
+
+/**
+ * @brief Check whether any job has not started yet
+ *
+ * @return True if a job is queued or waits for other jobs
+ */
+bool has_unstarted_job();
+
+/**
+ * @brief Count the background jobs that take up a slot
+ *
+ * @return Number of background jobs in state @a JOB_RUNNING
+ */
+size_t running_job_count();
+
+/**
+ * @brief Forget a job and return its slot to the slab
+ *
+ * @param job A job that is done or whose processes no longer matter
+ */
+void release_job(Job* job);
+
+/**
+ * @brief Find a background job by its job id
+ *
+ * @param id The job id shown to the user
+ *
+ * @return The job or NULL if there is no such job
+ */
+Job* find_job(int id);
+
+/**
+ * @brief Find the job a process belongs to
+ *
+ * @param pid Any process of the job that has not been reaped yet
+ *
+ * @return The job or NULL if @a pid does not belong to a job
+ */
+Job* find_job_by_pid(pid_t pid);
+
+/**
+ * @brief Find a finished background job that has not been reported yet
+ *
+ * @param pid Any process the job had
+ *
+ * @return The job or NULL if no such job waits to be reported
+ */
+Job* find_finished_job(pid_t pid);
+
+/**
+ * @brief The background job with the lowest job id
+ *
+ * @return The job or NULL if there are no background jobs
+ *
+ * @sa next_job()
+ */
+Job* first_job();
+
+/**
+ * @brief The background job with the highest job id
+ *
+ * @return The job or NULL if there are no background jobs
+ */
+Job* last_job();
+
+/**
+ * @brief The background job following @a job in job id order
+ *
+ * @param job A background job
+ *
+ * @return The next job or NULL if @a job is the last one
+ */
+Job* next_job(const Job* job);
+
+/**
+ * @brief A number that changes whenever a job is added, removed, changes
+ * state or moves between the foreground and the background
+ *
+ * @return The current version of the job table
+ */
+uint64_t job_table_version();
+
+/**
+ * @brief Reap every child that has exited without blocking
+ *
+ * Children are collected one wait4() call each until none is left. Each exit
+ * is matched to its job through the pid index. Background jobs whose last
+ * process exits are queued for take_finished_job(). Jobs whose time limit ran
+ * out are signalled first.
+ */
+void reap_jobs();
+
+/**
+ * @brief Block until every process of a job has exited or the job is stopped
+ *
+ * Other children that exit, stop or continue in the meantime are recorded
+ * against their own jobs. Time limits that run out meanwhile are enforced.
+ *
+ * @param job The job to wait for
+ *
+ * @return The wait status of the last process of the job
+ */
+int wait_for_job(Job* job);
+
+/**
+ * @brief Block until any child exits, stops or continues and reap it along
+ * with every other child that is ready
+ *
+ * Time limits that run out meanwhile are enforced.
+ *
+ * @return False if quash has no children to wait for
+ */
+bool wait_for_any_job();
+
+/**
+ * @brief Send a signal to every process of a job
+ *
+ * Jobs with a process group of their own are signalled with one killpg().
+ * Otherwise each process that has not been reaped gets its own kill().
+ *
+ * @param job A job that is not done
+ *
+ * @param sig The signal to send
+ *
+ * @return 0 on success or -1 with errno set
+ */
+int signal_job(Job* job, int sig);
+
+/**
+ * @brief Continue a stopped job
+ *
+ * Sends SIGCONT and marks the job as running right away, so a following
+ * wait_for_job() waits for the processes instead of returning at once.
+ *
+ * @param job A job that is not done
+ */
+void resume_job(Job* job);
+
+/**
+ * @brief Turn a job into a background job
+ *
+ * A job without a job id gets the lowest free one. The job is listed by
+ * first_job() and next_job() again and is reported through
+ * take_finished_job() once it is done.
+ *
+ * @param job A job that is not done
+ *
+ * @param cmd The command string to use if the job has none yet
+ */
+void move_job_to_background(Job* job, const char* cmd);
+
+/**
+ * @brief Take a background job out of the job list so quash can wait for it
+ *
+ * The job keeps its job id and is not reported when it finishes.
+ *
+ * @param job A background job that is not done
+ */
+void move_job_to_foreground(Job* job);
+
+/**
+ * @brief Take the oldest background job that finished and has not been
+ * reported yet
+ *
+ * The caller reports the job and then calls release_job() on it.
+ *
+ * @return A finished background job or NULL
+ */
+Job* take_finished_job();
+
+/**
+ * @brief Check for finished background jobs without taking them
+ *
+ * @return True if take_finished_job() would return a job
+ */
+bool has_finished_job();
+
+/**
+ * @brief Turn on terminal job control for an interactive quash
+ *
+ * Quash becomes the leader of its own process group and the foreground group
+ * of the terminal on standard in. Its terminal modes are saved so they can be
+ * restored whenever a job gives the terminal back. SIGTTOU must be ignored
+ * first, see start_event_loop().
+ */
+void start_job_control();
+
+/**
+ * @brief Check if start_job_control() succeeded
+ *
+ * @return True if every pipeline gets a process group of its own and
+ * foreground jobs get the terminal
+ */
+bool job_control_enabled();
+
+/**
+ * @brief Make the process group of a job the foreground group of the terminal
+ *
+ * Does nothing without job control or if the job has no process group.
+ *
+ * @param job The job to give the terminal to
+ */
+void give_terminal_to(const Job* job);
+
+/**
+ * @brief Make quash the foreground group of the terminal again and restore
+ * the terminal modes saved by start_job_control()
+ *
+ * Does nothing without job control.
+ */
+void take_terminal_back();
+
+/**
+ * @brief Release every job
+ *
+ * Jobs that are still pending pass @a Job.pending to free().
+ */
+void destroy_jobs();
+
+#endif
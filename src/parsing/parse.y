@@ -66,6 +66,13 @@ top: EOC_TOK {
 
   YYACCEPT;
 }
+|       END {
+  *__ret_cmds = NULL;
+
+  end_main_loop(EXIT_SUCCESS);
+
+  YYACCEPT;
+}
 |       cmds EOC_TOK {
   push_back_Cmds(&$1, mk_command_holder(NULL, NULL, 0, mk_eoc()));
 
@@ -104,19 +111,28 @@ cmds:   cmd_top {
 
   $$ = cs;
 }
-|       cmd_top PIPE cmds {
-  CommandHolder prev = pop_front_Cmds(&$3);
+|       cmds PIPE cmd_top {
+  /* Left recursion keeps the parser stack flat however long the pipeline */
+  CommandHolder prev = pop_back_Cmds(&$1);
 
-  $1.flags = ($1.flags & ~(REDIRECT_APPEND | REDIRECT_OUT)) | PIPE_OUT;
-  prev.flags = (prev.flags & ~REDIRECT_IN) | PIPE_IN;
+  prev.flags = (prev.flags & ~(REDIRECT_APPEND | REDIRECT_OUT)) | PIPE_OUT;
+  $3.flags = ($3.flags & ~REDIRECT_IN) | PIPE_IN;
 
-  if (prev.flags & BACKGROUND)
-    $1.flags |= BACKGROUND;
+  if ($3.flags & BACKGROUND) {
+    prev.flags |= BACKGROUND;
 
-  push_front_Cmds(&$3, prev);
-  push_front_Cmds(&$3, $1);
+    if (!is_empty_Cmds(&$1)) {
+      CommandHolder first = peek_front_Cmds(&$1);
 
-  $$ = $3;
+      first.flags |= BACKGROUND;
+      update_front_Cmds(&$1, first);
+    }
+  }
+
+  push_back_Cmds(&$1, prev);
+  push_back_Cmds(&$1, $3);
+
+  $$ = $1;
 }
 
 
@@ -164,7 +180,14 @@ cmd_content: cmd {
   $$ = mk_pwd_command();
 }
 |       JOBS_TOK {
-  $$ = mk_jobs_command();
+  char** cmd = memory_pool_alloc(2 * sizeof(char*));
+  cmd[0] = memory_pool_strdup("jobs");
+  cmd[1] = NULL;
+  $$ = mk_jobs_command(cmd);
+}
+|       JOBS_TOK cmd_arguments {
+  push_front_CmdStrs(&$2, memory_pool_strdup("jobs"));
+  $$ = mk_jobs_command(as_array_CmdStrs(&$2, NULL));
 }
 |       EXIT_TOK {
   $$ = mk_exit_command();
@@ -3,6 +3,9 @@
 #include <ctype.h>
 #include <stdbool.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "memory_pool.h"
 #include "parse.tab.h"
@@ -18,6 +21,28 @@ IMPLEMENT_DEQUE_MEMORY_POOL(CmdStrs, char*);
 IMPLEMENT_DEQUE_MEMORY_POOL(Cmds, CommandHolder);
 
 extern void destroy_lex();
+extern struct yy_buffer_state* yy_scan_bytes(const char*, int);
+extern struct yy_buffer_state* yy_scan_buffer(char*, size_t);
+extern void yy_delete_buffer(struct yy_buffer_state*);
+
+extern FILE* yyin;
+extern char* yytext;
+extern int yyleng;
+
+// Mapping holding a script file handed to the scanner
+static char* mapped_script = NULL;
+static size_t mapped_len = 0;
+
+// When standard in is mapped, the start of the scanned text and the offset in
+// the file it came from. Used to keep the file offset behind the parser.
+static char* stdin_text = NULL;
+static size_t stdin_text_len = 0;
+static off_t stdin_origin = 0;
+static off_t stdin_offset = 0;
+static struct yy_buffer_state* stdin_buffer = NULL;
+
+// Script file read through stdio because it could not be mapped
+static FILE* script_file = NULL;
 
 // Generate a string based off of a pipable generic command
 static inline void __stringify_generic_cmd(GenericCommand cmd, CmdStrs* strs) {
@@ -62,7 +87,21 @@ static void __stringify_simple_cmd(const char* str, CmdStrs* strs) {
 // Entry point for turning a command into a string
 static void __stringify_command(Command cmd, CmdStrs* strs) {
   switch (get_command_type(cmd)) {
+  // Builtins recognized by name keep the shape of a generic command
   case GENERIC:
+  case JOBS:
+  case HASH:
+  case EXEC:
+  case FG:
+  case BG:
+  case AFTER:
+  case WAIT:
+  case TIMEOUT:
+  case BUDGET:
+  case JOBLOG:
+  case TIME:
+  case BENCH:
+  case UTILITY:
     __stringify_generic_cmd(cmd.generic, strs);
     break;
 
@@ -86,10 +125,6 @@ static void __stringify_command(Command cmd, CmdStrs* strs) {
     __stringify_simple_cmd("PWD", strs);
     break;
 
-  case JOBS:
-    __stringify_simple_cmd("JOBS", strs);
-    break;
-
   case EXIT:
     __stringify_simple_cmd("EXIT", strs);
     break;
@@ -297,18 +332,128 @@ CommandHolder* parse(QuashState* state) {
 
   CommandHolder* holders;
 
+  // A program run by the last command read part of the script from standard
+  // in. Carry on after whatever it consumed.
+  if (stdin_text != NULL) {
+    off_t offset = lseek(STDIN_FILENO, 0, SEEK_CUR);
+
+    if (offset != stdin_offset && offset >= stdin_origin
+        && offset <= stdin_origin + (off_t) stdin_text_len) {
+      struct yy_buffer_state* old = stdin_buffer;
+      size_t skip = offset - stdin_origin;
+
+      stdin_buffer = yy_scan_buffer(stdin_text + skip,
+                                    stdin_text_len - skip + 2);
+      yy_delete_buffer(old);
+    }
+  }
+
   yyparse(&holders);
 
-  if (holders != NULL) {
-    CmdStrs strs = new_CmdStrs(10);
-    __stringify_script(holders, &strs);
-    state->parsed_str = __condense_string_array(as_array_CmdStrs(&strs, NULL));
+  // The string form is only needed for background jobs so it is built the
+  // first time somebody asks for it
+  state->parsed_str = NULL;
+  state->parsed_script = holders;
+
+  // Programs started by this command that read standard in should see what
+  // follows it, like they would if the shell read one line at a time
+  if (stdin_text != NULL && yytext >= stdin_text
+      && yytext + yyleng <= stdin_text + stdin_text_len) {
+    stdin_offset = stdin_origin + (yytext + yyleng - stdin_text);
+    lseek(STDIN_FILENO, stdin_offset, SEEK_SET);
   }
 
   return holders;
 }
 
+// Build the string form of a parsed script
+char* stringify_script(const CommandHolder* holders) {
+  CmdStrs strs = new_CmdStrs(10);
+
+  __stringify_script(holders, &strs);
+
+  return __condense_string_array(as_array_CmdStrs(&strs, NULL));
+}
+
+// Map a regular file into memory and scan it in place. Anything else is read
+// through stdio.
+void parse_from_file(int fd) {
+  struct stat st;
+  off_t origin = lseek(fd, 0, SEEK_CUR);
+
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && origin >= 0
+      && origin <= st.st_size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    off_t map_origin = origin & ~((off_t) page - 1);
+    size_t file_len = st.st_size - map_origin;
+    size_t text_len = st.st_size - origin;
+
+    // The scanner wants two NUL bytes after the text. An anonymous mapping
+    // with room for them is laid down first and the file mapped over its
+    // start. The bytes after the end of the file read as zero either way.
+    mapped_len = (file_len + 2 + page - 1) & ~(page - 1);
+    mapped_script = mmap(NULL, mapped_len, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (mapped_script != MAP_FAILED && file_len > 0
+        && mmap(mapped_script, file_len, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_FIXED, fd, map_origin) == MAP_FAILED) {
+      munmap(mapped_script, mapped_len);
+      mapped_script = MAP_FAILED;
+    }
+
+    if (mapped_script != MAP_FAILED) {
+      char* text = mapped_script + (origin - map_origin);
+
+      // Sequential reads let the kernel fault the file in ahead of the scanner
+      madvise(mapped_script, mapped_len, MADV_SEQUENTIAL);
+
+      struct yy_buffer_state* buffer = yy_scan_buffer(text, text_len + 2);
+
+      if (fd == STDIN_FILENO) {
+        stdin_text = text;
+        stdin_text_len = text_len;
+        stdin_origin = stdin_offset = origin;
+        stdin_buffer = buffer;
+      }
+      else {
+        close(fd);
+      }
+
+      return;
+    }
+
+    mapped_script = NULL;
+  }
+
+  if (fd != STDIN_FILENO)
+    yyin = script_file = fdopen(fd, "r");
+}
+
+// Make the parser read from a string instead of standard in
+void parse_from_string(const char* str) {
+  size_t len = strlen(str);
+
+  // Without trailing white space the final command ends the input instead of
+  // an empty line, so the parser can tell it is the last one
+  while (len > 0 && isspace((unsigned char) str[len - 1]))
+    --len;
+
+  yy_scan_bytes(str, len);
+}
+
 // Clean up dynamically allocated memory in the parser
 void destroy_parser() {
   destroy_lex();
+
+  if (mapped_script != NULL)
+    munmap(mapped_script, mapped_len);
+
+  if (script_file != NULL)
+    fclose(script_file);
+
+  mapped_script = NULL;
+  script_file = NULL;
+  stdin_text = NULL;
+  stdin_buffer = NULL;
 }
@@ -87,8 +87,9 @@ char* interpret_complex_string_token(const char* str);
  * @brief Handles the call to the parser and provides a string equivalent of the
  * @a Command structure to @a QuashState
  *
- * @param[out] state The state of the quash shell. The parsed_str member of
- * QuashState is set to the stringified command structure.
+ * @param[out] state The state of the quash shell. The parsed_script member of
+ * QuashState is set to the command structure and parsed_str is cleared until
+ * get_command_string() asks for it.
  *
  * @return A pointer to the parsed command structure
  *
@@ -96,6 +97,41 @@ char* interpret_complex_string_token(const char* str);
  */
 CommandHolder* parse(QuashState* state);
 
+/**
+ * @brief Build a string equivalent of a parsed script
+ *
+ * @param holders The script returned by parse()
+ *
+ * @return The string allocated on the @a MemoryPool
+ *
+ * @sa parse(), get_command_string()
+ */
+char* stringify_script(const CommandHolder* holders);
+
+/**
+ * @brief Read commands from a file descriptor instead of standard in
+ *
+ * A regular file is mapped into memory and scanned in place, so large scripts
+ * are parsed without copying them through stdio. Anything else, like a pipe,
+ * is read through stdio. When @a fd is standard in its offset is kept just
+ * past the last command parsed so programs started by the script can read
+ * what follows it.
+ *
+ * @param fd The descriptor to read. Quash owns it from now on unless it is
+ * standard in.
+ */
+void parse_from_file(int fd);
+
+/**
+ * @brief Read commands from @a str instead of standard in
+ *
+ * Trailing white space is dropped so the last command is followed directly by
+ * the end of the input.
+ *
+ * @param str The commands to parse. The string is copied.
+ */
+void parse_from_string(const char* str);
+
 /**
  * @brief Cleanup memory dynamically allocated by the parser
  */
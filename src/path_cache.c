@@ -0,0 +1,302 @@
+/**
+ * @file path_cache.c
+ *
+ * @brief Implements a hash table from program names to their location in PATH
+ */
+
+#define _GNU_SOURCE
+
+#include "path_cache.h"
+
+#include "builtin_io.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+ * @brief One slot of the open addressing hash table
+ */
+typedef struct PathEntry {
+  char* name;    /**< Program name or NULL if the slot is free */
+  char* path;    /**< Absolute path or NULL if @a name is not in PATH */
+  unsigned hits; /**< Number of lookups answered by this entry */
+} PathEntry;
+
+/**
+ * @brief Modification time of a PATH directory when the cache was filled
+ */
+typedef struct PathDirStamp {
+  char* dir;             /**< Directory name */
+  struct timespec mtime; /**< Last modification time, zero if it is missing */
+} PathDirStamp;
+
+static PathEntry* table = NULL;
+static size_t table_cap = 0;
+static size_t table_len = 0;
+
+static char* snapshot_path = NULL;
+static PathDirStamp* stamps = NULL;
+static size_t stamps_len = 0;
+
+// FNV-1a string hash
+static size_t __hash(const char* str) {
+  size_t h = 14695981039346656037UL;
+
+  for (; *str != '\0'; ++str)
+    h = (h ^ (unsigned char) *str) * 1099511628211UL;
+
+  return h;
+}
+
+// Find the slot holding name or the free slot where it belongs
+static PathEntry* __find_slot(const char* name) {
+  size_t i = __hash(name) & (table_cap - 1);
+
+  while (table[i].name != NULL && strcmp(table[i].name, name) != 0)
+    i = (i + 1) & (table_cap - 1);
+
+  return &table[i];
+}
+
+// Double the size of the table and rehash everything in it
+static void __grow_table() {
+  PathEntry* old = table;
+  size_t old_cap = table_cap;
+
+  table_cap = (old_cap == 0) ? 64 : old_cap * 2;
+  table = calloc(table_cap, sizeof(PathEntry));
+
+  if (table == NULL) {
+    fprintf(stderr, "ERROR: Failed to allocate path cache\n");
+    exit(-1);
+  }
+
+  for (size_t i = 0; i < old_cap; ++i) {
+    if (old[i].name != NULL)
+      *__find_slot(old[i].name) = old[i];
+  }
+
+  free(old);
+}
+
+// Record the modification time of every directory in PATH
+static void __take_snapshot() {
+  const char* path = getenv("PATH");
+
+  snapshot_path = strdup((path != NULL) ? path : "");
+
+  char* dirs = strdup(snapshot_path);
+  char* save;
+
+  for (char* dir = strtok_r(dirs, ":", &save); dir != NULL;
+       dir = strtok_r(NULL, ":", &save)) {
+    struct stat st;
+
+    stamps = realloc(stamps, (stamps_len + 1) * sizeof(PathDirStamp));
+    stamps[stamps_len].dir = strdup(dir);
+    stamps[stamps_len].mtime = (stat(dir, &st) == 0) ? st.st_mtim
+                                                    : (struct timespec) { 0 };
+    ++stamps_len;
+  }
+
+  free(dirs);
+}
+
+// Search PATH for an executable regular file. Relative PATH entries depend on
+// the working directory so anything found through them is not cacheable.
+static char* __search_path(const char* name, bool* cacheable) {
+  const char* path = getenv("PATH");
+  size_t name_len = strlen(name);
+
+  *cacheable = true;
+
+  if (path == NULL)
+    return NULL;
+
+  while (true) {
+    const char* end = strchrnul(path, ':');
+    size_t dir_len = end - path;
+    char candidate[dir_len + name_len + 3];
+    struct stat st;
+
+    if (dir_len == 0) {
+      strcpy(candidate, name);
+    }
+    else {
+      memcpy(candidate, path, dir_len);
+      candidate[dir_len] = '/';
+      strcpy(candidate + dir_len + 1, name);
+    }
+
+    if (stat(candidate, &st) == 0 && S_ISREG(st.st_mode)
+        && access(candidate, X_OK) == 0) {
+      *cacheable = candidate[0] == '/';
+      return strdup(candidate);
+    }
+
+    if (*end == '\0')
+      return NULL;
+
+    path = end + 1;
+  }
+}
+
+// Insert or replace an entry
+static PathEntry* __store(const char* name, char* path) {
+  if ((table_len + 1) * 2 > table_cap)
+    __grow_table();
+
+  PathEntry* slot = __find_slot(name);
+
+  if (slot->name == NULL) {
+    slot->name = strdup(name);
+    slot->hits = 0;
+    ++table_len;
+  }
+  else {
+    free(slot->path);
+  }
+
+  slot->path = path;
+
+  return slot;
+}
+
+// Look up a program name, searching PATH on a miss
+const char* lookup_command_path(const char* name) {
+  if (strchr(name, '/') != NULL)
+    return name;
+
+  if (snapshot_path == NULL)
+    __take_snapshot();
+
+  if (table_cap > 0) {
+    PathEntry* slot = __find_slot(name);
+
+    if (slot->name != NULL) {
+      ++slot->hits;
+      return slot->path;
+    }
+  }
+
+  bool cacheable;
+  char* path = __search_path(name, &cacheable);
+
+  if (!cacheable) {
+    // Keep the result alive until the next uncacheable lookup
+    static char* uncached = NULL;
+
+    free(uncached);
+    uncached = path;
+    return path;
+  }
+
+  PathEntry* slot = __store(name, path);
+  slot->hits = 1;
+
+  return slot->path;
+}
+
+// Search PATH for name and remember the answer
+bool seed_command_path(const char* name) {
+  if (strchr(name, '/') != NULL)
+    return true;
+
+  if (snapshot_path == NULL)
+    __take_snapshot();
+
+  bool cacheable;
+  char* path = __search_path(name, &cacheable);
+
+  if (path == NULL)
+    return false;
+
+  if (!cacheable) {
+    free(path);
+    return true;
+  }
+
+  __store(name, path);
+
+  return true;
+}
+
+// Empty the cache and forget the PATH snapshot
+void clear_command_path_cache() {
+  for (size_t i = 0; i < table_cap; ++i) {
+    free(table[i].name);
+    free(table[i].path);
+    table[i].name = table[i].path = NULL;
+  }
+
+  table_len = 0;
+
+  for (size_t i = 0; i < stamps_len; ++i)
+    free(stamps[i].dir);
+
+  free(stamps);
+  free(snapshot_path);
+  stamps = NULL;
+  stamps_len = 0;
+  snapshot_path = NULL;
+}
+
+// Drop the cache if PATH or one of its directories changed
+void revalidate_command_path_cache() {
+  if (snapshot_path == NULL)
+    return;
+
+  const char* path = getenv("PATH");
+
+  if (strcmp(snapshot_path, (path != NULL) ? path : "") != 0) {
+    clear_command_path_cache();
+    return;
+  }
+
+  for (size_t i = 0; i < stamps_len; ++i) {
+    struct stat st;
+    struct timespec mtime = (stat(stamps[i].dir, &st) == 0) ? st.st_mtim
+                                                           : (struct timespec) { 0 };
+
+    if (mtime.tv_sec != stamps[i].mtime.tv_sec
+        || mtime.tv_nsec != stamps[i].mtime.tv_nsec) {
+      clear_command_path_cache();
+      return;
+    }
+  }
+}
+
+// Print every entry in the cache in a format similar to bash's hash builtin
+void print_command_path_cache() {
+  if (table_len == 0) {
+    builtin_printf("hash: hash table empty\n");
+    builtin_flush();
+    return;
+  }
+
+  builtin_printf("hits\tcommand\n");
+
+  for (size_t i = 0; i < table_cap; ++i) {
+    if (table[i].name == NULL)
+      continue;
+
+    if (table[i].path != NULL)
+      builtin_printf("%4u\t%s\n", table[i].hits, table[i].path);
+    else
+      builtin_printf("%4u\t%s (not found)\n", table[i].hits, table[i].name);
+  }
+
+  builtin_flush();
+}
+
+// Free the table itself along with its contents
+void destroy_command_path_cache() {
+  clear_command_path_cache();
+
+  free(table);
+  table = NULL;
+  table_cap = 0;
+}
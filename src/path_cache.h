@@ -0,0 +1,62 @@
+/**
+ * @file path_cache.h
+ *
+ * @brief Remembers where programs named on the command line live in PATH
+ */
+
+#ifndef SRC_PATH_CACHE_H
+#define SRC_PATH_CACHE_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Find the absolute path of a program by searching PATH
+ *
+ * Results are cached, including names that could not be found, so a repeated
+ * lookup costs a single hash table probe. Names containing a '/' are returned
+ * unchanged without searching PATH.
+ *
+ * @param name The program name as typed by the user
+ *
+ * @return The path to execute or NULL if no executable file called @a name
+ * exists in PATH. The string belongs to the cache and is only valid until the
+ * cache is cleared.
+ */
+const char* lookup_command_path(const char* name);
+
+/**
+ * @brief Resolve a program and add it to the cache even if it is already
+ * present
+ *
+ * @param name The program name to look up
+ *
+ * @return True if the program was found in PATH
+ */
+bool seed_command_path(const char* name);
+
+/**
+ * @brief Throw away everything in the cache
+ */
+void clear_command_path_cache();
+
+/**
+ * @brief Clear the cache if PATH or any directory listed in it has changed
+ * since the cache was filled
+ *
+ * This is meant to be called once before a command line is run. It compares
+ * the current PATH string and the modification time of every directory in it
+ * against a snapshot taken when the cache was last cleared.
+ */
+void revalidate_command_path_cache();
+
+/**
+ * @brief Print the contents of the cache to standard out
+ */
+void print_command_path_cache();
+
+/**
+ * @brief Release all memory held by the cache
+ */
+void destroy_command_path_cache();
+
+#endif
@@ -0,0 +1,184 @@
+/**
+ * @file proc_stats.c
+ *
+ * @brief Implements reading /proc and the cache of samples
+ */
+
+#include "proc_stats.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// How long a sample stays in the cache, in nanoseconds
+#define SAMPLE_TTL (100 * 1000 * 1000L)
+
+// Samples ordered by pid. Gone processes are kept with state 0 so they are
+// not looked for again.
+static ProcStats* samples = NULL;
+static size_t num_samples = 0;
+static size_t sample_cap = 0;
+
+// When the oldest sample in the cache was taken on CLOCK_MONOTONIC
+static struct timespec sampled;
+
+// Read a small file from /proc in one go. Returns its length or -1.
+static ssize_t __read_proc_file(pid_t pid, const char* name, char* buf,
+                                size_t len) {
+  char path[32];
+
+  snprintf(path, sizeof(path), "/proc/%d/%s", (int) pid, name);
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+  if (fd < 0)
+    return -1;
+
+  ssize_t n = read(fd, buf, len - 1);
+
+  close(fd);
+
+  if (n < 0)
+    return -1;
+
+  buf[n] = '\0';
+
+  return n;
+}
+
+// Find the value following `key` in a "key: value" file
+static bool __find_counter(const char* buf, const char* key, uint64_t* out) {
+  const char* at = strstr(buf, key);
+  unsigned long long value;
+
+  if (at == NULL || sscanf(at + strlen(key), "%llu", &value) != 1)
+    return false;
+
+  *out = value;
+
+  return true;
+}
+
+bool read_proc_stats(pid_t pid, ProcStats* stats, bool with_io) {
+  char buf[512];
+  unsigned long long utime, stime;
+  long long cutime, cstime;
+  long rss;
+  char state;
+
+  if (__read_proc_file(pid, "stat", buf, sizeof(buf)) <= 0)
+    return false;
+
+  // The command name may hold spaces and parentheses, so fields are counted
+  // from the parenthesis that closes it
+  char* open_paren = strchr(buf, '(');
+  char* fields = strrchr(buf, ')');
+
+  if (open_paren == NULL || fields == NULL || fields < open_paren
+      || sscanf(fields + 1, " %c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u"
+                " %llu %llu %lld %lld %*d %*d %*d %*d %*u %*u %ld",
+                &state, &utime, &stime, &cutime, &cstime, &rss) != 6)
+    return false;
+
+  size_t comm_len = fields - open_paren - 1;
+
+  if (comm_len >= sizeof(stats->comm))
+    comm_len = sizeof(stats->comm) - 1;
+
+  memset(stats, 0, sizeof(ProcStats));
+  memcpy(stats->comm, open_paren + 1, comm_len);
+  stats->pid = pid;
+  stats->state = state;
+  stats->ticks = utime + stime + cutime + cstime;
+  stats->pages = (rss > 0) ? rss : 0;
+
+  // Reading someone else's counters needs the same rights as ptrace, so
+  // their absence is not an error
+  if (with_io && __read_proc_file(pid, "io", buf, sizeof(buf)) > 0) {
+    stats->has_io = __find_counter(buf, "rchar:", &stats->read_bytes)
+                    && __find_counter(buf, "wchar:", &stats->write_bytes);
+  }
+
+  return true;
+}
+
+// Order samples by pid
+static int __compare_samples(const void* a, const void* b) {
+  pid_t x = ((const ProcStats*) a)->pid;
+  pid_t y = ((const ProcStats*) b)->pid;
+
+  return (x > y) - (x < y);
+}
+
+// The sample of a pid among the first `count`, gone or not, or NULL
+static ProcStats* __find_sample(pid_t pid, size_t count) {
+  ProcStats key = { pid };
+
+  if (count == 0)
+    return NULL;
+
+  return bsearch(&key, samples, count, sizeof(ProcStats), __compare_samples);
+}
+
+// Drop the cache once its oldest sample is older than SAMPLE_TTL
+static void __expire_samples() {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  if (num_samples > 0
+      && (now.tv_sec - sampled.tv_sec) * 1000000000L
+         + (now.tv_nsec - sampled.tv_nsec) < SAMPLE_TTL)
+    return;
+
+  num_samples = 0;
+  sampled = now;
+}
+
+// New samples are appended and sorted once at the end, so a pass over n
+// processes stays at O(n log n). The pids of one pass are distinct.
+void sample_proc_stats(const pid_t* pids, size_t num_pids) {
+  __expire_samples();
+
+  size_t sorted = num_samples;
+
+  for (size_t i = 0; i < num_pids; ++i) {
+    if (__find_sample(pids[i], sorted) != NULL)
+      continue;
+
+    if (num_samples == sample_cap) {
+      size_t cap = (sample_cap == 0) ? 16 : sample_cap * 2;
+      ProcStats* grown = realloc(samples, cap * sizeof(ProcStats));
+
+      if (grown == NULL)
+        break;
+
+      samples = grown;
+      sample_cap = cap;
+    }
+
+    ProcStats* sample = &samples[num_samples++];
+
+    if (!read_proc_stats(pids[i], sample, true))
+      *sample = (ProcStats) { pids[i] };
+  }
+
+  if (num_samples != sorted)
+    qsort(samples, num_samples, sizeof(ProcStats), __compare_samples);
+}
+
+const ProcStats* cached_proc_stats(pid_t pid) {
+  const ProcStats* sample = __find_sample(pid, num_samples);
+
+  return (sample != NULL && sample->state != 0) ? sample : NULL;
+}
+
+void destroy_proc_stats() {
+  free(samples);
+  samples = NULL;
+  num_samples = 0;
+  sample_cap = 0;
+}
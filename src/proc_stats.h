@@ -0,0 +1,75 @@
+/**
+ * @file proc_stats.h
+ *
+ * @brief Reads what Linux reports about a process in /proc
+ *
+ * A process is described by /proc/PID/stat, which holds its state, CPU time
+ * and resident memory in a single read, and /proc/PID/io, which counts the
+ * bytes it moved through read() and write(). Samples taken for display are
+ * kept for a tenth of a second, so a script listing the same processes over
+ * and over reads each of them once while a person always sees fresh numbers.
+ */
+
+#ifndef SRC_PROC_STATS_H
+#define SRC_PROC_STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * @brief One sample of a process
+ */
+typedef struct ProcStats {
+  pid_t pid;              /**< The process */
+  char state;             /**< State letter as ps shows it */
+  char comm[16];          /**< Program name, cut short by the kernel */
+  unsigned long long ticks; /**< User and system time in clock ticks,
+                             * including children it waited for */
+  size_t pages;           /**< Resident memory in pages */
+  bool has_io;            /**< False if /proc/PID/io could not be read */
+  uint64_t read_bytes;    /**< Bytes read by the process, from any file */
+  uint64_t write_bytes;   /**< Bytes written by the process, to any file */
+} ProcStats;
+
+/**
+ * @brief Read /proc/PID/stat and, if asked, /proc/PID/io
+ *
+ * @param pid The process
+ *
+ * @param stats Where to store the sample
+ *
+ * @param with_io Also read the I/O counters. Without it @a has_io is false.
+ *
+ * @return False if the process is gone
+ */
+bool read_proc_stats(pid_t pid, ProcStats* stats, bool with_io);
+
+/**
+ * @brief Sample processes that are not in the cache yet
+ *
+ * All of them are read in one pass, including their I/O counters. The cache
+ * is emptied first if its samples have grown stale.
+ *
+ * @param pids The processes
+ *
+ * @param num_pids Number of entries in @a pids
+ */
+void sample_proc_stats(const pid_t* pids, size_t num_pids);
+
+/**
+ * @brief Look up a sample taken by sample_proc_stats()
+ *
+ * @param pid The process
+ *
+ * @return The sample or NULL if the process was gone or not sampled
+ */
+const ProcStats* cached_proc_stats(pid_t pid);
+
+/**
+ * @brief Release the memory of the cache
+ */
+void destroy_proc_stats();
+
+#endif
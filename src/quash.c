@@ -9,14 +9,23 @@
  **************************************************************************/
 #include "quash.h"
 
+#include <errno.h>
+#include <fcntl.h>
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
 
 #include "command.h"
+#include "event_loop.h"
 #include "execute.h"
+#include "job_log.h"
+#include "jobs.h"
 #include "parsing_interface.h"
 #include "memory_pool.h"
+#include "path_cache.h"
+#include "proc_stats.h"
+#include "shm_jobs.h"
+#include "spawn_backend.h"
 
 /**************************************************************************
  * Private Variables
@@ -49,10 +58,28 @@ static void print_prompt() {
     free (cwd);
 }
 
+// Sleep until the user has typed a line. Background jobs that finish in the
+// meantime are reported right away and the prompt is shown again.
+static void wait_for_input() {
+  publish_job_table();
+
+  while (wait_for_event() != EVENT_INPUT) {
+    reap_jobs();
+    publish_job_table();
+
+    if (has_finished_job()) {
+      putchar('\n');
+      check_jobs_bg_status();
+      print_prompt();
+    }
+  }
+}
+
 QuashState initial_state() {
   return (QuashState) {
     true,
     isatty(STDIN_FILENO),
+    NULL,
     NULL
   };
 }
@@ -67,6 +94,9 @@ bool is_running() {
 
 // Get a copy of the string
 char* get_command_string() {
+  if (state.parsed_str == NULL && state.parsed_script != NULL)
+    state.parsed_str = stringify_script(state.parsed_script);
+
   return strdup(state.parsed_str);
 }
 
@@ -89,9 +119,53 @@ void end_main_loop(int exit_status) {
  * @return program exit status
  */
 int main(int argc, char** argv) {
+  // "quash -c COMMANDS" runs COMMANDS and exits. Nothing is set up that the
+  // commands themselves do not ask for.
+  bool one_shot = argc > 1 && strcmp(argv[1], "-c") == 0;
+
+  if (one_shot && argc < 3) {
+    fprintf(stderr, "quash: -c: option requires an argument\n");
+    return 2;
+  }
+
+  // Fork the zygote while quash is still small. In one shot mode it is only
+  // started on demand.
+  if (!one_shot)
+    start_spawn_zygote();
+
   state = initial_state();
 
+  // Before any thread exists, so all of them keep SIGCHLD blocked
+  watch_child_signals();
+
+  if (one_shot) {
+    state.is_a_tty = false;
+    parse_from_string(argv[2]);
+  }
+  else if (argc > 1) {
+    // "quash FILE" runs the script in FILE
+    int fd = open(argv[1], O_RDONLY | O_CLOEXEC);
+
+    if (fd < 0) {
+      fprintf(stderr, "quash: %s: %s\n", argv[1], strerror(errno));
+      return EXIT_FAILURE;
+    }
+
+    state.is_a_tty = false;
+    parse_from_file(fd);
+  }
+  else if (!is_tty()) {
+    parse_from_file(STDIN_FILENO);
+  }
+
   if (is_tty()) {
+    // Stdio must not read ahead of the parser or epoll would miss lines that
+    // are already waiting in its buffer
+    setvbuf(stdin, NULL, _IONBF, 0);
+
+    if (start_event_loop())
+      start_job_control();
+
     puts("Welcome to Quash!");
     puts("Type \"exit\" or \"quit\" to quit");
     puts("---------------------------------");
@@ -100,11 +174,19 @@ int main(int argc, char** argv) {
 
   atexit(destroy_parser);
   atexit(destroy_memory_pool);
+  atexit(destroy_command_path_cache);
+  atexit(destroy_proc_stats);
+  atexit(destroy_jobs);
+  atexit(destroy_job_logs);
+  atexit(close_job_table);
+  atexit(stop_event_loop);
 
   // Main execution loop
   while (is_running()) {
-    if (is_tty())
+    if (is_tty()) {
       print_prompt();
+      wait_for_input();
+    }
 
     initialize_memory_pool(1024);
 
@@ -112,16 +194,29 @@ int main(int argc, char** argv) {
 
     /* if (script != NULL) */
     /*   run_script(script); */
-    CommandHolder* script;
+    CommandHolder* script = NULL;
 
-    while ((script = parse(&state)) == NULL); // Parse until we come across
-                                              // something that is an
-                                              // interesting command while also
-                                              // not a syntax error
-    run_script(script);
+    // Parse until we come across something that is an interesting command
+    // while also not a syntax error. The parser stops the loop at end of input.
+    // An interactive shell reads a single line so it can go back to waiting.
+    if (is_tty())
+      script = parse(&state);
+    else
+      while (is_running() && (script = parse(&state)) == NULL);
+
+    // The parser stops the loop when it reaches the end of the input. What it
+    // returned along with that is the last command quash will run.
+    if (script != NULL && one_shot && !is_running())
+      run_final_script(script);
+    else if (script != NULL)
+      run_script(script);
 
     destroy_memory_pool();
   }
 
+  // Queued jobs were promised to run unless QUASH_EXIT_GRACE says to end
+  // every job
+  shutdown_jobs();
+
   return EXIT_SUCCESS;
 }
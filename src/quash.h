@@ -21,7 +21,10 @@ typedef struct QuashState {
   bool is_a_tty;    /**< Indicates if the shell is receiving input from a file
                      * or the command line */
   char* parsed_str; /**< Holds a string representing the parsed structure of the
-                     * command input from the command line */
+                     * command input from the command line. NULL until
+                     * get_command_string() first needs it. */
+  const CommandHolder* parsed_script; /**< The last script returned by the
+                                       * parser */
 } QuashState;
 
 /**
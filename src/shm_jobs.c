@@ -0,0 +1,228 @@
+/**
+ * @file shm_jobs.c
+ *
+ * @brief Implements the copy of the job table kept in shared memory
+ */
+
+#define _GNU_SOURCE
+
+#include "shm_jobs.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "jobs.h"
+
+// Entries the object has room for when it is created
+#define INITIAL_CAPACITY 32
+
+static QuashShmHeader* table = NULL;
+static size_t mapped = 0;
+static int table_fd = -1;
+static pid_t owner = 0;
+static char name[32];
+
+// Job table version the shared copy matches. Only valid while `fresh`.
+static uint64_t published = 0;
+static bool fresh = false;
+
+// Set when the object could not be created. Quash stops trying until the
+// variable is unset again.
+static bool failed = false;
+
+// True if QUASH_JOB_TABLE asks for the table
+static bool __enabled() {
+  const char* value = getenv("QUASH_JOB_TABLE");
+
+  return value != NULL && *value != '\0' && strcmp(value, "0") != 0;
+}
+
+// Bytes needed for a table with room for `capacity` jobs
+static size_t __table_size(uint32_t capacity) {
+  return sizeof(QuashShmHeader) + capacity * sizeof(QuashShmJob);
+}
+
+// Create and map the object. It is readable by everyone, like the command
+// lines ps shows.
+static bool __open_table() {
+  size_t size = __table_size(INITIAL_CAPACITY);
+
+  snprintf(name, sizeof(name), "/" QUASH_SHM_PREFIX "%d", (int) getpid());
+  table_fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+  if (table_fd < 0)
+    return false;
+
+  if (ftruncate(table_fd, size) < 0
+      || (table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                       table_fd, 0)) == MAP_FAILED) {
+    shm_unlink(name);
+    close(table_fd);
+    table_fd = -1;
+    table = NULL;
+    return false;
+  }
+
+  *table = (QuashShmHeader) {
+    QUASH_SHM_MAGIC,
+    QUASH_SHM_VERSION,
+    0,
+    INITIAL_CAPACITY,
+    0,
+    getpid(),
+    0,
+    0
+  };
+
+  mapped = size;
+  owner = getpid();
+  fresh = false;
+
+  return true;
+}
+
+// Make room for `count` jobs. Readers learn about it through `capacity`,
+// which is only changed inside a write.
+static bool __reserve(uint32_t count, uint32_t* capacity) {
+  uint32_t cap = table->capacity;
+
+  while (cap < count)
+    cap *= 2;
+
+  if (cap == table->capacity) {
+    *capacity = cap;
+    return true;
+  }
+
+  size_t size = __table_size(cap);
+  void* grown;
+
+  if (ftruncate(table_fd, size) < 0
+      || (grown = mremap(table, mapped, size, MREMAP_MAYMOVE)) == MAP_FAILED)
+    return false;
+
+  table = grown;
+  mapped = size;
+  *capacity = cap;
+
+  return true;
+}
+
+// Make the sequence odd so readers know a write is under way
+static void __begin_write() {
+  __atomic_store_n(&table->seq, table->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+// Make the sequence even again once everything is written
+static void __end_write() {
+  __atomic_store_n(&table->seq, table->seq + 1, __ATOMIC_RELEASE);
+}
+
+// State of a job as published
+static uint32_t __shm_state(JobState state) {
+  switch (state) {
+  case JOB_RUNNING:
+    return QUASH_SHM_RUNNING;
+
+  case JOB_STOPPED:
+    return QUASH_SHM_STOPPED;
+
+  case JOB_DONE:
+    return QUASH_SHM_DONE;
+
+  case JOB_PENDING:
+  default:
+    return QUASH_SHM_PENDING;
+  }
+}
+
+// Fill in the entry of one job
+static void __write_job(QuashShmJob* entry, const Job* job) {
+  size_t num_pids = (job->num_pids < QUASH_SHM_PIDS) ? job->num_pids
+                                                     : QUASH_SHM_PIDS;
+
+  entry->id = job->id;
+  entry->pgid = job->pgid;
+  entry->state = __shm_state(job->state);
+  entry->num_pids = job->num_pids;
+  entry->start_sec = job->started.tv_sec;
+  entry->start_nsec = job->started.tv_nsec;
+
+  for (size_t i = 0; i < QUASH_SHM_PIDS; ++i)
+    entry->pids[i] = (i < num_pids) ? job->pids[i] : 0;
+
+  snprintf(entry->cmd, sizeof(entry->cmd), "%s",
+           (job->cmd != NULL) ? job->cmd : "");
+}
+
+// Rewrites the whole table. Jobs change rarely compared to how often quash
+// goes to sleep, so the version check is what usually runs.
+void publish_job_table() {
+  if (!__enabled()) {
+    close_job_table();
+    failed = false;
+    return;
+  }
+
+  if (failed || (fresh && published == job_table_version()))
+    return;
+
+  if (table == NULL && !__open_table()) {
+    perror("ERROR: Failed to publish job table");
+    failed = true;
+    return;
+  }
+
+  uint32_t count = 0;
+  uint32_t capacity = table->capacity;
+  struct timespec now;
+
+  for (Job* job = first_job(); job != NULL; job = next_job(job))
+    ++count;
+
+  // Without more room the jobs with the highest numbers are left out
+  if (!__reserve(count, &capacity) && count > capacity)
+    count = capacity;
+
+  QuashShmJob* entries = (QuashShmJob*) (table + 1);
+  uint32_t i = 0;
+
+  clock_gettime(CLOCK_REALTIME, &now);
+  __begin_write();
+
+  for (Job* job = first_job(); job != NULL && i < count; job = next_job(job))
+    __write_job(&entries[i++], job);
+
+  table->capacity = capacity;
+  table->num_jobs = i;
+  table->updated_sec = now.tv_sec;
+  table->updated_nsec = now.tv_nsec;
+
+  __end_write();
+
+  published = job_table_version();
+  fresh = true;
+}
+
+void close_job_table() {
+  if (table == NULL)
+    return;
+
+  // A forked child of quash on its way out must not take the table along
+  if (owner == getpid())
+    shm_unlink(name);
+
+  munmap(table, mapped);
+  close(table_fd);
+
+  table = NULL;
+  table_fd = -1;
+  mapped = 0;
+  fresh = false;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file shm_jobs.h
+ *
+ * @brief Publishes the job table in shared memory for monitoring tools
+ *
+ * While QUASH_JOB_TABLE is set, quash keeps a copy of its job table in the
+ * POSIX shared memory object "/quash-PID", which Linux shows as
+ * /dev/shm/quash-PID. Once a reader has mapped it, reading the table takes no
+ * system call at all and quash never notices. The object is removed when
+ * quash exits or the variable is unset.
+ *
+ * The object starts with a @a QuashShmHeader followed by @a capacity entries
+ * of type @a QuashShmJob, of which the first @a num_jobs are in use. All
+ * fields have fixed sizes and native byte order. Quash rewrites the table
+ * before each command and whenever it is about to sleep, and only if a job
+ * changed since.
+ *
+ * Writes are guarded by a sequence lock. The writer makes @a seq odd, changes
+ * the table and makes @a seq even again. A reader loads @a seq with acquire
+ * semantics and starts over while it is odd, copies what it needs, issues an
+ * acquire fence and loads @a seq again. The copy is consistent if both loads
+ * returned the same value. The table only ever grows. A reader that finds
+ * @a capacity larger than what it mapped has to map the object again.
+ *
+ * This header only uses fixed width types so tools can include it on their
+ * own.
+ */
+
+#ifndef SRC_SHM_JOBS_H
+#define SRC_SHM_JOBS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** @brief Value of @a QuashShmHeader.magic, "QJOB" in a little endian dump */
+#define QUASH_SHM_MAGIC 0x424f4a51u
+
+/** @brief Layout version. Changes whenever the structures below change. */
+#define QUASH_SHM_VERSION 1
+
+/** @brief Most process ids stored per job */
+#define QUASH_SHM_PIDS 8
+
+/** @brief Size of the command string of a job including its NUL */
+#define QUASH_SHM_CMD 160
+
+/** @brief Prefix of the shared memory object name, followed by the pid */
+#define QUASH_SHM_PREFIX "quash-"
+
+/**
+ * @brief State of a published job
+ */
+typedef enum QuashShmState {
+  QUASH_SHM_PENDING = 0, /**< Queued or waiting for other jobs */
+  QUASH_SHM_RUNNING,     /**< At least one process is running */
+  QUASH_SHM_STOPPED,     /**< Every live process is stopped */
+  QUASH_SHM_DONE         /**< Finished but not reported yet */
+} QuashShmState;
+
+/**
+ * @brief Start of the shared memory object
+ */
+typedef struct QuashShmHeader {
+  uint32_t magic;       /**< @a QUASH_SHM_MAGIC */
+  uint32_t version;     /**< @a QUASH_SHM_VERSION */
+  uint32_t seq;         /**< Sequence lock, odd while the table changes */
+  uint32_t capacity;    /**< Entries the object has room for */
+  uint32_t num_jobs;    /**< Entries in use */
+  int32_t shell_pid;    /**< Process id of the quash that owns the table */
+  int64_t updated_sec;  /**< When the table was last written, CLOCK_REALTIME */
+  int64_t updated_nsec; /**< Nanoseconds of @a updated_sec */
+} QuashShmHeader;
+
+/**
+ * @brief One job of the table, in order of job id
+ */
+typedef struct QuashShmJob {
+  int32_t id;                     /**< Job number as shown by jobs */
+  int32_t pgid;                   /**< Process group, 0 if it has none */
+  uint32_t state;                 /**< A @a QuashShmState */
+  uint32_t num_pids;              /**< Processes in the pipeline. Only the
+                                   * first @a QUASH_SHM_PIDS are listed. */
+  int64_t start_sec;              /**< When the job started, CLOCK_REALTIME.
+                                   * 0 if it has not. */
+  int64_t start_nsec;             /**< Nanoseconds of @a start_sec */
+  int32_t pids[QUASH_SHM_PIDS];   /**< Processes in pipeline order */
+  char cmd[QUASH_SHM_CMD];        /**< Command line, NUL terminated and cut
+                                   * short if needed */
+} QuashShmJob;
+
+/**
+ * @brief Bring the shared table in line with the job table
+ *
+ * Creates the object when QUASH_JOB_TABLE is set to anything but "0" and
+ * removes it once the variable is unset. Does nothing when no job changed
+ * since the last call.
+ */
+void publish_job_table();
+
+/**
+ * @brief Remove the shared memory object
+ *
+ * Only the quash that created it does so. Its children may call this on
+ * their way out without harm.
+ */
+void close_job_table();
+
+#endif
@@ -0,0 +1,526 @@
+/**
+ * @file spawn_backend.c
+ *
+ * @brief Implements the vfork, posix_spawn and zygote process creation backends
+ */
+
+#define _GNU_SOURCE
+
+#include "spawn_backend.h"
+
+#include "event_loop.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+/**
+ * @brief Largest launch request that can be sent to the zygote. Bigger
+ * requests are launched with posix_spawn() instead.
+ */
+#define ZYGOTE_MAX_MSG (64 * 1024)
+
+/**
+ * @brief Fixed size header of a launch request sent to the zygote
+ *
+ * The header is followed by the working directory, the program path, @a argc
+ * argument strings and
+ * @a envc environment strings, each NUL terminated. Environment strings of the
+ * form "NAME=VALUE" are set and a bare "NAME" is unset. The standard in,
+ * standard out and standard error descriptors travel as SCM_RIGHTS ancillary
+ * data.
+ */
+typedef struct ZygoteRequest {
+  pid_t pgid;          /**< Process group to join or 0 to lead a new one */
+  uint32_t foreground; /**< Non-zero if the program takes the terminal */
+  uint32_t argc;       /**< Number of argument strings */
+  uint32_t envc;       /**< Number of environment strings */
+} ZygoteRequest;
+
+/**
+ * @brief Answer from the zygote to a @a ZygoteRequest
+ */
+typedef struct ZygoteReply {
+  pid_t pid; /**< Process id of the launched program or -1 */
+  int err;   /**< errno value if the program failed to start, 0 otherwise */
+} ZygoteReply;
+
+extern char** environ;
+
+static SpawnBackend backend;
+static bool backend_resolved = false;
+
+static int zygote_sock = -1;
+
+static char** changed_env = NULL;
+static size_t changed_env_len = 0;
+
+// Read the backend out of the QUASH_SPAWN environment variable
+SpawnBackend get_spawn_backend() {
+  if (!backend_resolved) {
+    const char* name = getenv("QUASH_SPAWN");
+
+    if (name != NULL && strcmp(name, "fork") == 0)
+      backend = SPAWN_FORK;
+    else if (name != NULL && strcmp(name, "vfork") == 0)
+      backend = SPAWN_VFORK;
+    else if (name != NULL && strcmp(name, "zygote") == 0)
+      backend = SPAWN_ZYGOTE;
+    else
+      backend = SPAWN_POSIX;
+
+    backend_resolved = true;
+  }
+
+  return backend;
+}
+
+// Force QUASH_SPAWN to be looked up again
+void reset_spawn_backend() {
+  backend_resolved = false;
+}
+
+// Move the calling process into its job's process group. SIGTTOU is blocked
+// around tcsetpgrp() since a process outside the foreground group would be
+// stopped by it otherwise.
+void join_process_group(pid_t pgid, bool take_terminal) {
+  sigset_t ttou;
+  sigset_t old;
+
+  if (pgid < 0)
+    return;
+
+  setpgid(0, pgid);
+
+  if (take_terminal) {
+    sigemptyset(&ttou);
+    sigaddset(&ttou, SIGTTOU);
+    sigprocmask(SIG_BLOCK, &ttou, &old);
+    tcsetpgrp(STDIN_FILENO, getpgrp());
+    sigprocmask(SIG_SETMASK, &old, NULL);
+  }
+}
+
+// Launch with vfork(). The child shares our memory until it calls exec so it
+// may only touch the stack and make async-signal-safe calls. A failed exec is
+// reported back through exec_errno which the parent can read once vfork()
+// returns.
+static pid_t __spawn_vfork(const char* path, char** args, int in_fd,
+                           int out_fd, int err_fd, pid_t pgid,
+                           bool foreground) {
+  static volatile int exec_errno;
+  pid_t pid;
+
+  exec_errno = 0;
+
+  if ((pid = vfork()) == 0) {
+    join_process_group(pgid, foreground);
+
+    if (in_fd != STDIN_FILENO)
+      dup2(in_fd, STDIN_FILENO);
+
+    if (out_fd != STDOUT_FILENO)
+      dup2(out_fd, STDOUT_FILENO);
+
+    if (err_fd != STDERR_FILENO)
+      dup2(err_fd, STDERR_FILENO);
+
+    reset_child_signals();
+    execv(path, args);
+
+    exec_errno = errno;
+    _exit(EXIT_FAILURE);
+  }
+
+  if (pid > 0 && exec_errno != 0) {
+    // The child has already exited. Collect it here so the caller only ever
+    // sees processes that actually started.
+    waitpid(pid, NULL, 0);
+    errno = exec_errno;
+    return -1;
+  }
+
+  return pid;
+}
+
+// Launch with posix_spawn(). Redirections become dup2 file actions which the
+// library performs between clone and exec. The process group is set before
+// any file action, so the terminal is handed over while standard in is still
+// quash's.
+static pid_t __spawn_posix(const char* path, char** args, int in_fd,
+                           int out_fd, int err_fd, pid_t pgid,
+                           bool foreground) {
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attr;
+  const sigset_t* mask = child_signal_mask();
+  const sigset_t* defaults = child_default_signals();
+  short flags = 0;
+  pid_t pid;
+  int err;
+
+  posix_spawn_file_actions_init(&actions);
+  posix_spawnattr_init(&attr);
+
+  // Undo the signal setup done by the event loop
+  if (mask != NULL) {
+    posix_spawnattr_setsigmask(&attr, mask);
+    flags |= POSIX_SPAWN_SETSIGMASK;
+  }
+
+  if (defaults != NULL) {
+    posix_spawnattr_setsigdefault(&attr, defaults);
+    flags |= POSIX_SPAWN_SETSIGDEF;
+  }
+
+  if (pgid >= 0) {
+    posix_spawnattr_setpgroup(&attr, pgid);
+    flags |= POSIX_SPAWN_SETPGROUP;
+
+    if (foreground)
+      posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+  }
+
+  posix_spawnattr_setflags(&attr, flags);
+
+  if (in_fd != STDIN_FILENO)
+    posix_spawn_file_actions_adddup2(&actions, in_fd, STDIN_FILENO);
+
+  if (out_fd != STDOUT_FILENO)
+    posix_spawn_file_actions_adddup2(&actions, out_fd, STDOUT_FILENO);
+
+  if (err_fd != STDERR_FILENO)
+    posix_spawn_file_actions_adddup2(&actions, err_fd, STDERR_FILENO);
+
+  err = posix_spawn(&pid, path, &actions, &attr, args, environ);
+
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+
+  if (err != 0) {
+    errno = err;
+    return -1;
+  }
+
+  return pid;
+}
+
+// Send a buffer along with three file descriptors over a Unix socket
+static ssize_t __send_with_fds(int sock, const void* buf, size_t len,
+                               int in_fd, int out_fd, int err_fd) {
+  int fds[3] = { in_fd, out_fd, err_fd };
+  char control[CMSG_SPACE(sizeof(fds))];
+  struct iovec iov = { (void*) buf, len };
+  struct msghdr msg = { 0 };
+  struct cmsghdr* cmsg;
+
+  memset(control, 0, sizeof(control));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  return sendmsg(sock, &msg, MSG_NOSIGNAL);
+}
+
+// Receive a buffer and the three file descriptors sent by __send_with_fds()
+static ssize_t __recv_with_fds(int sock, void* buf, size_t len, int fds[3]) {
+  char control[CMSG_SPACE(3 * sizeof(int))];
+  struct iovec iov = { buf, len };
+  struct msghdr msg = { 0 };
+  struct cmsghdr* cmsg;
+  ssize_t n;
+
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  fds[0] = fds[1] = fds[2] = -1;
+
+  if ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) <= 0)
+    return n;
+
+  for (cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+      memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+  }
+
+  return n;
+}
+
+// Runs in the zygote. Unpack a launch request and start the program. The
+// program is started from a short lived intermediate process so that it is
+// reparented to quash (a child subreaper) as soon as the intermediate exits.
+// A close-on-exec status pipe tells us the pid and whether exec succeeded.
+static ZygoteReply __zygote_launch(char* msg, size_t len, int in_fd,
+                                   int out_fd, int err_fd) {
+  ZygoteRequest req;
+  ZygoteReply reply = { -1, EINVAL };
+  int status[2];
+  pid_t mid;
+
+  if (len < sizeof(req))
+    return reply;
+
+  memcpy(&req, msg, sizeof(req));
+
+  char* cwd = msg + sizeof(req);
+  char* path = cwd + strlen(cwd) + 1;
+  char* p = path + strlen(path) + 1;
+  char* argv[req.argc + 1];
+  char* envs[req.envc + 1];
+
+  for (uint32_t i = 0; i < req.argc; ++i, p += strlen(p) + 1)
+    argv[i] = p;
+  argv[req.argc] = NULL;
+
+  for (uint32_t i = 0; i < req.envc; ++i, p += strlen(p) + 1)
+    envs[i] = p;
+
+  if (pipe2(status, O_CLOEXEC) < 0) {
+    reply.err = errno;
+    return reply;
+  }
+
+  if ((mid = fork()) == 0) {
+    pid_t pid = fork();
+
+    if (pid == 0) {
+      join_process_group(req.pgid, req.foreground);
+
+      if (chdir(cwd) < 0)
+        goto fail;
+
+      for (uint32_t i = 0; i < req.envc; ++i) {
+        if (strchr(envs[i], '=') != NULL)
+          putenv(envs[i]);
+        else
+          unsetenv(envs[i]);
+      }
+
+      dup2(in_fd, STDIN_FILENO);
+      dup2(out_fd, STDOUT_FILENO);
+      dup2(err_fd, STDERR_FILENO);
+
+      execv(path, argv);
+
+    fail:
+      write(status[1], &errno, sizeof(errno));
+      _exit(EXIT_FAILURE);
+    }
+
+    write(status[1], &pid, sizeof(pid));
+    if (pid < 0)
+      write(status[1], &errno, sizeof(errno));
+
+    _exit(EXIT_SUCCESS);
+  }
+
+  close(status[1]);
+
+  if (mid < 0) {
+    reply.err = errno;
+  }
+  else {
+    waitpid(mid, NULL, 0);
+
+    if (read(status[0], &reply.pid, sizeof(reply.pid)) != sizeof(reply.pid))
+      reply.pid = -1;
+
+    // End of file means the status pipe was closed by a successful exec
+    if (read(status[0], &reply.err, sizeof(reply.err)) != sizeof(reply.err))
+      reply.err = (reply.pid > 0) ? 0 : EAGAIN;
+  }
+
+  close(status[0]);
+
+  return reply;
+}
+
+// Main loop of the zygote process. Serves launch requests until quash closes
+// its end of the socket.
+static void __zygote_main(int sock) {
+  static char msg[ZYGOTE_MAX_MSG];
+  int fds[3];
+  ssize_t len;
+
+  // Keep terminal generated signals meant for quash's foreground away from us
+  setpgid(0, 0);
+
+  // Programs launched from here inherit our signal setup, so it must be quash's
+  // original one even if the zygote was started after the event loop
+  reset_child_signals();
+
+  while ((len = __recv_with_fds(sock, msg, sizeof(msg) - 1, fds)) > 0) {
+    msg[len] = '\0';
+
+    ZygoteReply reply = __zygote_launch(msg, len, fds[0], fds[1], fds[2]);
+
+    close(fds[0]);
+    close(fds[1]);
+    close(fds[2]);
+
+    send(sock, &reply, sizeof(reply), MSG_NOSIGNAL);
+  }
+
+  _exit(EXIT_SUCCESS);
+}
+
+// Fork the zygote. Nothing happens if it is already running.
+static void __start_zygote() {
+  int sv[2];
+  pid_t pid;
+
+  if (zygote_sock >= 0)
+    return;
+
+  if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0) {
+    perror("ERROR: Failed to create zygote socket");
+    return;
+  }
+
+  if ((pid = fork()) == 0) {
+    close(sv[0]);
+    __zygote_main(sv[1]);
+  }
+
+  close(sv[1]);
+
+  if (pid < 0) {
+    perror("ERROR: Failed to start zygote");
+    close(sv[0]);
+    return;
+  }
+
+  prctl(PR_SET_CHILD_SUBREAPER, 1);
+  zygote_sock = sv[0];
+}
+
+// Start the zygote early if it was requested
+void start_spawn_zygote() {
+  if (get_spawn_backend() == SPAWN_ZYGOTE)
+    __start_zygote();
+}
+
+// Remember an environment variable that differs from the zygote's copy
+void note_spawn_env_change(const char* name) {
+  for (size_t i = 0; i < changed_env_len; ++i) {
+    if (strcmp(changed_env[i], name) == 0)
+      return;
+  }
+
+  char** grown = realloc(changed_env, (changed_env_len + 1) * sizeof(char*));
+
+  if (grown == NULL)
+    return;
+
+  changed_env = grown;
+  changed_env[changed_env_len++] = strdup(name);
+}
+
+// Append a string to a zygote request. Returns false if it does not fit.
+static bool __append_msg(char* msg, size_t* len, const char* a, const char* b) {
+  size_t alen = strlen(a);
+  size_t blen = (b != NULL) ? strlen(b) + 1 : 0;
+
+  if (*len + alen + blen + 1 > ZYGOTE_MAX_MSG)
+    return false;
+
+  memcpy(msg + *len, a, alen);
+  *len += alen;
+
+  if (b != NULL) {
+    msg[(*len)++] = '=';
+    memcpy(msg + *len, b, blen - 1);
+    *len += blen - 1;
+  }
+
+  msg[(*len)++] = '\0';
+
+  return true;
+}
+
+// Launch through the zygote. Falls back to posix_spawn() when the zygote is
+// unavailable or the request is too large to send.
+static pid_t __spawn_zygote(const char* path, char** args, int in_fd,
+                            int out_fd, int err_fd, pid_t pgid,
+                            bool foreground) {
+  static char msg[ZYGOTE_MAX_MSG];
+  char cwd[PATH_MAX];
+  ZygoteRequest req = { (pgid < 0) ? getpgrp() : pgid, foreground, 0, 0 };
+  ZygoteReply reply;
+  size_t len = sizeof(req);
+  bool fits = getcwd(cwd, sizeof(cwd)) != NULL;
+
+  __start_zygote();
+
+  fits = fits && __append_msg(msg, &len, cwd, NULL);
+  fits = fits && __append_msg(msg, &len, path, NULL);
+
+  for (; fits && args[req.argc] != NULL; ++req.argc)
+    fits = __append_msg(msg, &len, args[req.argc], NULL);
+
+  for (; fits && req.envc < changed_env_len; ++req.envc)
+    fits = __append_msg(msg, &len, changed_env[req.envc],
+                        getenv(changed_env[req.envc]));
+
+  if (!fits || zygote_sock < 0)
+    return __spawn_posix(path, args, in_fd, out_fd, err_fd, pgid,
+                         foreground);
+
+  memcpy(msg, &req, sizeof(req));
+
+  if (__send_with_fds(zygote_sock, msg, len, in_fd, out_fd, err_fd) < 0
+      || recv(zygote_sock, &reply, sizeof(reply), 0) != sizeof(reply)) {
+    // The zygote is gone. Stop using it.
+    close(zygote_sock);
+    zygote_sock = -1;
+    return __spawn_posix(path, args, in_fd, out_fd, err_fd, pgid,
+                         foreground);
+  }
+
+  if (reply.err != 0) {
+    // A program that failed to exec was still reparented to us
+    if (reply.pid > 0)
+      waitpid(reply.pid, NULL, 0);
+
+    errno = reply.err;
+    return -1;
+  }
+
+  return reply.pid;
+}
+
+// Launch a program with the requested backend
+pid_t spawn_generic(SpawnBackend backend, const char* path, char** args,
+                    int in_fd, int out_fd, int err_fd, pid_t pgid,
+                    bool foreground) {
+  switch (backend) {
+  case SPAWN_VFORK:
+    return __spawn_vfork(path, args, in_fd, out_fd, err_fd, pgid, foreground);
+
+  case SPAWN_ZYGOTE:
+    return __spawn_zygote(path, args, in_fd, out_fd, err_fd, pgid, foreground);
+
+  case SPAWN_POSIX:
+  default:
+    return __spawn_posix(path, args, in_fd, out_fd, err_fd, pgid, foreground);
+  }
+}
@@ -0,0 +1,119 @@
+/**
+ * @file spawn_backend.h
+ *
+ * @brief Process creation backends used to launch non-builtin programs
+ */
+
+#ifndef SRC_SPAWN_BACKEND_H
+#define SRC_SPAWN_BACKEND_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+/**
+ * @brief All process creation strategies quash can use for a @a GenericCommand
+ *
+ * The backend is selected at runtime with the QUASH_SPAWN environment variable
+ * which may hold one of "fork", "vfork", "spawn" or "zygote". Builtin commands that must
+ * run in a child always use fork() since they execute quash code after the
+ * process is created.
+ *
+ * @sa get_spawn_backend(), spawn_generic()
+ */
+typedef enum SpawnBackend {
+  SPAWN_FORK = 0, /**< Full fork() followed by exec in the child */
+  SPAWN_VFORK,    /**< vfork() sharing the parent's address space until exec */
+  SPAWN_POSIX,    /**< posix_spawn() with dup2 file actions */
+  SPAWN_ZYGOTE    /**< Ask a helper process forked at startup to launch it */
+} SpawnBackend;
+
+/**
+ * @brief Get the backend selected by the QUASH_SPAWN environment variable
+ *
+ * The variable is only read the first time this is called or after a call to
+ * reset_spawn_backend(). Unknown values fall back to @a SPAWN_POSIX.
+ *
+ * @return The currently selected @a SpawnBackend
+ */
+SpawnBackend get_spawn_backend();
+
+/**
+ * @brief Forget the cached backend so QUASH_SPAWN is read again on next use
+ */
+void reset_spawn_backend();
+
+/**
+ * @brief Fork the zygote helper process if QUASH_SPAWN selects it
+ *
+ * This should be called as early as possible in main() so the zygote is a copy
+ * of a small process. Launching through the zygote then costs the same no
+ * matter how large quash itself grows. The zygote exits on its own once quash
+ * closes its end of the socket.
+ *
+ * @note Quash becomes a child subreaper so programs started by the zygote are
+ * reparented to quash and can be waited on like any other child.
+ */
+void start_spawn_zygote();
+
+/**
+ * @brief Record that an environment variable was changed by quash
+ *
+ * The zygote holds the environment quash had at startup. Variables recorded
+ * here are sent along with every launch request so programs started by the
+ * zygote see the same environment as quash.
+ *
+ * @param name Name of the environment variable that was set
+ */
+void note_spawn_env_change(const char* name);
+
+/**
+ * @brief Launch a program with its standard in and standard out attached to
+ * the given file descriptors
+ *
+ * The descriptors are opened by the caller. They are only duplicated onto
+ * STDIN_FILENO and STDOUT_FILENO in the new process and are never closed by
+ * this function.
+ *
+ * @param backend One of @a SPAWN_VFORK, @a SPAWN_POSIX or @a SPAWN_ZYGOTE
+ *
+ * @param path Location of the program to execute as returned by
+ * lookup_command_path()
+ *
+ * @param args A NULL terminated array of c-strings passed to the program as its
+ * arguments
+ *
+ * @param in_fd Descriptor to use as standard in for the new process
+ *
+ * @param out_fd Descriptor to use as standard out for the new process
+ *
+ * @param err_fd Descriptor to use as standard error for the new process
+ *
+ * @param pgid Process group to join, 0 to make the new process the leader of
+ * a new group or -1 to stay in quash's group
+ *
+ * @param foreground True if the process group should be given the terminal
+ * on quash's standard in
+ *
+ * @return The process id of the new process or -1 with errno set if the
+ * program could not be started
+ */
+pid_t spawn_generic(SpawnBackend backend, const char* path, char** args,
+                    int in_fd, int out_fd, int err_fd, pid_t pgid,
+                    bool foreground);
+
+/**
+ * @brief Move the calling process into a process group and optionally give
+ * that group the terminal
+ *
+ * Meant to be called in a new process before exec. Only async-signal-safe
+ * calls are made so it is safe after vfork().
+ *
+ * @param pgid Process group to join, 0 to lead a new group or -1 to do
+ * nothing
+ *
+ * @param take_terminal True if the group becomes the foreground group of the
+ * terminal on standard in
+ */
+void join_process_group(pid_t pgid, bool take_terminal);
+
+#endif
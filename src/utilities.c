@@ -0,0 +1,1160 @@
+/**
+ * @file utilities.c
+ *
+ * @brief Implements the small programs quash runs without starting a process
+ */
+
+#define _GNU_SOURCE
+
+#include "utilities.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "builtin_io.h"
+
+/**
+ * @brief Output collected before it is handed to builtin_write()
+ *
+ * Builtin output that goes to a pipe costs a system call per write, so the
+ * utilities fill this first.
+ */
+typedef struct Output {
+  char data[4096]; /**< Bytes not written yet */
+  size_t len;      /**< Number of bytes in @a data */
+  bool closed;     /**< True once nobody reads the output anymore */
+} Output;
+
+// Hand the collected bytes to the builtin's sink
+static void __out_flush(Output* out) {
+  if (out->len > 0 && !out->closed) {
+    builtin_write(out->data, out->len);
+    out->closed = builtin_output_closed();
+  }
+
+  out->len = 0;
+}
+
+// Append bytes to the output. Bytes that do not fit are written directly.
+static void __out_write(Output* out, const char* data, size_t len) {
+  if (out->len + len > sizeof(out->data)) {
+    __out_flush(out);
+
+    if (len > sizeof(out->data)) {
+      if (!out->closed) {
+        builtin_write(data, len);
+        out->closed = builtin_output_closed();
+      }
+
+      return;
+    }
+  }
+
+  memcpy(out->data + out->len, data, len);
+  out->len += len;
+}
+
+// Append a single character to the output
+static void __out_char(Output* out, char c) {
+  __out_write(out, &c, 1);
+}
+
+// Append to the output like snprintf() would
+static void __out_format(Output* out, const char* fmt, ...) {
+  char small[256];
+  va_list args;
+  int len;
+
+  va_start(args, fmt);
+  len = vsnprintf(small, sizeof(small), fmt, args);
+  va_end(args);
+
+  if (len < 0)
+    return;
+
+  if ((size_t) len < sizeof(small)) {
+    __out_write(out, small, len);
+    return;
+  }
+
+  char* large = malloc(len + 1);
+
+  if (large == NULL)
+    return;
+
+  va_start(args, fmt);
+  vsnprintf(large, len + 1, fmt, args);
+  va_end(args);
+
+  __out_write(out, large, len);
+  free(large);
+}
+
+// Write everything out before the utility returns
+static void __out_finish(Output* out) {
+  __out_flush(out);
+  builtin_flush();
+}
+
+// Skip the "--" that may end the options of a utility without any
+static int __first_operand(char** argv) {
+  return (argv[1] != NULL && strcmp(argv[1], "--") == 0) ? 2 : 1;
+}
+
+/***************************************************************************
+ * true and false
+ ***************************************************************************/
+static int __run_true(int argc, char** argv) {
+  (void) argc;
+  (void) argv;
+
+  return 0;
+}
+
+static int __run_false(int argc, char** argv) {
+  (void) argc;
+  (void) argv;
+
+  return 1;
+}
+
+/***************************************************************************
+ * test and [
+ ***************************************************************************/
+/**
+ * @brief State of evaluating the expression of test
+ */
+typedef struct TestParser {
+  const char* name; /**< "test" or "[" for error messages */
+  char** args;      /**< The expression */
+  int pos;          /**< Next argument to look at */
+  int end;          /**< One past the last argument of the expression */
+  bool failed;      /**< True once an error was reported */
+} TestParser;
+
+// Report the first error in the expression. Test exits with 2 then.
+static void __test_error(TestParser* p, const char* arg, const char* what) {
+  if (p->failed)
+    return;
+
+  if (arg != NULL)
+    fprintf(stderr, "%s: %s: %s\n", p->name, arg, what);
+  else
+    fprintf(stderr, "%s: %s\n", p->name, what);
+
+  p->failed = true;
+}
+
+// True if `op` is an operator that takes one operand
+static bool __is_unary(const char* op) {
+  return op[0] == '-' && op[1] != '\0' && op[2] == '\0'
+         && strchr("bcdefghkLnprsStuwxz", op[1]) != NULL;
+}
+
+// True if `op` is an operator that takes two operands
+static bool __is_binary(const char* op) {
+  static const char* const ops[] = {
+    "=", "==", "!=", "<", ">", "-eq", "-ne", "-lt", "-le", "-gt", "-ge",
+    "-nt", "-ot", "-ef"
+  };
+
+  for (size_t i = 0; i < sizeof(ops) / sizeof(ops[0]); ++i) {
+    if (strcmp(op, ops[i]) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+// Read an operand of an integer comparison
+static long long __test_integer(TestParser* p, const char* str) {
+  char* end;
+  long long value;
+
+  errno = 0;
+  value = strtoll(str, &end, 10);
+
+  while (isspace((unsigned char) *end))
+    ++end;
+
+  if (end == str || *end != '\0' || errno == ERANGE)
+    __test_error(p, str, "integer expression expected");
+
+  return value;
+}
+
+// Evaluate a unary file or string operator
+static bool __test_unary(char op, const char* arg) {
+  struct stat st;
+
+  switch (op) {
+  case 'n':
+    return arg[0] != '\0';
+
+  case 'z':
+    return arg[0] == '\0';
+
+  case 't':
+    return isatty(atoi(arg));
+
+  case 'r':
+    return access(arg, R_OK) == 0;
+
+  case 'w':
+    return access(arg, W_OK) == 0;
+
+  case 'x':
+    return access(arg, X_OK) == 0;
+
+  case 'h':
+  case 'L':
+    return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+
+  default:
+    break;
+  }
+
+  if (stat(arg, &st) < 0)
+    return false;
+
+  switch (op) {
+  case 'b':
+    return S_ISBLK(st.st_mode);
+
+  case 'c':
+    return S_ISCHR(st.st_mode);
+
+  case 'd':
+    return S_ISDIR(st.st_mode);
+
+  case 'f':
+    return S_ISREG(st.st_mode);
+
+  case 'p':
+    return S_ISFIFO(st.st_mode);
+
+  case 'S':
+    return S_ISSOCK(st.st_mode);
+
+  case 's':
+    return st.st_size > 0;
+
+  case 'g':
+    return (st.st_mode & S_ISGID) != 0;
+
+  case 'u':
+    return (st.st_mode & S_ISUID) != 0;
+
+  case 'k':
+    return (st.st_mode & S_ISVTX) != 0;
+
+  case 'e':
+  default:
+    return true;
+  }
+}
+
+// Order two modification times
+static int __compare_mtime(const struct stat* a, const struct stat* b) {
+  if (a->st_mtim.tv_sec != b->st_mtim.tv_sec)
+    return (a->st_mtim.tv_sec > b->st_mtim.tv_sec) ? 1 : -1;
+
+  return (a->st_mtim.tv_nsec > b->st_mtim.tv_nsec)
+         - (a->st_mtim.tv_nsec < b->st_mtim.tv_nsec);
+}
+
+// Evaluate a binary operator
+static bool __test_binary(TestParser* p, const char* a, const char* op,
+                          const char* b) {
+  if (strcmp(op, "=") == 0 || strcmp(op, "==") == 0)
+    return strcmp(a, b) == 0;
+
+  if (strcmp(op, "!=") == 0)
+    return strcmp(a, b) != 0;
+
+  if (strcmp(op, "<") == 0)
+    return strcmp(a, b) < 0;
+
+  if (strcmp(op, ">") == 0)
+    return strcmp(a, b) > 0;
+
+  if (strcmp(op, "-nt") == 0 || strcmp(op, "-ot") == 0
+      || strcmp(op, "-ef") == 0) {
+    struct stat sa, sb;
+    bool has_a = stat(a, &sa) == 0;
+    bool has_b = stat(b, &sb) == 0;
+
+    // A file that does not exist is older than any that does
+    if (strcmp(op, "-nt") == 0)
+      return has_a && (!has_b || __compare_mtime(&sa, &sb) > 0);
+
+    if (strcmp(op, "-ot") == 0)
+      return has_b && (!has_a || __compare_mtime(&sa, &sb) < 0);
+
+    return has_a && has_b && sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+  }
+
+  long long x = __test_integer(p, a);
+  long long y = __test_integer(p, b);
+
+  if (strcmp(op, "-eq") == 0)
+    return x == y;
+
+  if (strcmp(op, "-ne") == 0)
+    return x != y;
+
+  if (strcmp(op, "-lt") == 0)
+    return x < y;
+
+  if (strcmp(op, "-le") == 0)
+    return x <= y;
+
+  if (strcmp(op, "-gt") == 0)
+    return x > y;
+
+  return x >= y;
+}
+
+static bool __test_or(TestParser* p);
+
+// A comparison, a test of one operand, a string or a parenthesized
+// expression. A binary operator in the middle wins, so "test ! = x" compares
+// two strings like POSIX asks for.
+static bool __test_primary(TestParser* p) {
+  char** at = p->args + p->pos;
+  int left = p->end - p->pos;
+
+  if (left >= 3 && __is_binary(at[1])) {
+    p->pos += 3;
+    return __test_binary(p, at[0], at[1], at[2]);
+  }
+
+  if (left >= 2 && strcmp(at[0], "(") == 0) {
+    ++p->pos;
+
+    bool result = __test_or(p);
+
+    if (p->pos < p->end && strcmp(p->args[p->pos], ")") == 0)
+      ++p->pos;
+    else
+      __test_error(p, NULL, "')' expected");
+
+    return result;
+  }
+
+  if (left >= 2 && __is_unary(at[0])) {
+    p->pos += 2;
+    return __test_unary(at[0][1], at[1]);
+  }
+
+  if (left >= 1) {
+    ++p->pos;
+    return at[0][0] != '\0';
+  }
+
+  __test_error(p, NULL, "argument expected");
+
+  return false;
+}
+
+// A primary, possibly negated
+static bool __test_not(TestParser* p) {
+  int left = p->end - p->pos;
+
+  if (left >= 2 && strcmp(p->args[p->pos], "!") == 0
+      && !(left >= 3 && __is_binary(p->args[p->pos + 1]))) {
+    ++p->pos;
+    return !__test_not(p);
+  }
+
+  return __test_primary(p);
+}
+
+// Terms joined by -a
+static bool __test_and(TestParser* p) {
+  bool result = __test_not(p);
+
+  while (p->pos < p->end && strcmp(p->args[p->pos], "-a") == 0) {
+    ++p->pos;
+
+    bool rhs = __test_not(p);
+
+    result = result && rhs;
+  }
+
+  return result;
+}
+
+// Terms joined by -o
+static bool __test_or(TestParser* p) {
+  bool result = __test_and(p);
+
+  while (p->pos < p->end && strcmp(p->args[p->pos], "-o") == 0) {
+    ++p->pos;
+
+    bool rhs = __test_and(p);
+
+    result = result || rhs;
+  }
+
+  return result;
+}
+
+static int __run_test(int argc, char** argv) {
+  TestParser p = { argv[0], argv, 1, argc, false };
+
+  if (strcmp(argv[0], "[") == 0) {
+    if (strcmp(argv[argc - 1], "]") != 0) {
+      fprintf(stderr, "[: missing ']'\n");
+      return 2;
+    }
+
+    --p.end;
+  }
+
+  if (p.end == 1)
+    return 1;
+
+  bool result = __test_or(&p);
+
+  if (p.pos < p.end)
+    __test_error(&p, p.args[p.pos], "unexpected argument");
+
+  return p.failed ? 2 : !result;
+}
+
+/***************************************************************************
+ * printf
+ ***************************************************************************/
+// Take the next argument of printf or NULL once they ran out
+static const char* __next_arg(char*** args) {
+  return (**args == NULL) ? NULL : *(*args)++;
+}
+
+// Read the backslash escape at `str`, just past the backslash, into `chars`.
+// Octal escapes are "\NNN" in a format and "\0NNN" in a "%b" argument.
+// Returns how many characters of `str` it used or -1 for "\c", which ends all
+// output.
+static int __read_escape(const char* str, bool in_arg, char* chars,
+                         int* num_chars) {
+  static const char from[] = "\\abfnrtv\"'";
+  static const char to[] = "\\\a\b\f\n\r\t\v\"'";
+  const char* found = (*str != '\0') ? strchr(from, *str) : NULL;
+
+  *num_chars = 1;
+
+  if (found != NULL) {
+    chars[0] = to[found - from];
+    return 1;
+  }
+
+  if (*str == 'c')
+    return -1;
+
+  if (*str >= '0' && *str <= '7') {
+    const char* digit = (in_arg && *str == '0') ? str + 1 : str;
+    int value = 0;
+
+    for (int n = 0; n < 3 && *digit >= '0' && *digit <= '7'; ++n, ++digit)
+      value = value * 8 + (*digit - '0');
+
+    chars[0] = (char) value;
+    return digit - str;
+  }
+
+  // Not an escape. The backslash stays.
+  chars[0] = '\\';
+
+  if (*str == '\0')
+    return 0;
+
+  chars[1] = *str;
+  *num_chars = 2;
+
+  return 1;
+}
+
+// Complain about a numeric argument of printf that was not read completely.
+// Like other implementations printf still prints what it could read.
+static void __check_number(const char* arg, const char* end, int* status) {
+  if (errno == ERANGE) {
+    fprintf(stderr, "printf: %s: %s\n", arg, strerror(ERANGE));
+    *status = 1;
+  }
+  else if (end == arg || *end != '\0') {
+    fprintf(stderr, "printf: %s: expected a numeric value\n", arg);
+    *status = 1;
+  }
+}
+
+// A leading quote makes the value of the character after it
+static bool __is_char_constant(const char* arg) {
+  return arg[0] == '\'' || arg[0] == '"';
+}
+
+// Read the argument of a signed integer conversion
+static long long __printf_signed(const char* arg, int* status) {
+  char* end;
+  long long value;
+
+  if (arg == NULL || *arg == '\0')
+    return 0;
+
+  if (__is_char_constant(arg))
+    return (unsigned char) arg[1];
+
+  errno = 0;
+  value = strtoll(arg, &end, 0);
+  __check_number(arg, end, status);
+
+  return value;
+}
+
+// Read the argument of an unsigned integer conversion
+static unsigned long long __printf_unsigned(const char* arg, int* status) {
+  char* end;
+  unsigned long long value;
+
+  if (arg == NULL || *arg == '\0')
+    return 0;
+
+  if (__is_char_constant(arg))
+    return (unsigned char) arg[1];
+
+  errno = 0;
+  value = strtoull(arg, &end, 0);
+  __check_number(arg, end, status);
+
+  return value;
+}
+
+// Read the argument of a floating point conversion
+static double __printf_double(const char* arg, int* status) {
+  char* end;
+  double value;
+
+  if (arg == NULL || *arg == '\0')
+    return 0;
+
+  if (__is_char_constant(arg))
+    return (unsigned char) arg[1];
+
+  errno = 0;
+  value = strtod(arg, &end);
+  __check_number(arg, end, status);
+
+  return value;
+}
+
+// Read a width or precision at fmt[*i]. A '*' takes it from the next
+// argument. Returns false if there is none.
+static bool __read_field(const char* fmt, size_t* i, char*** args,
+                         int* status, int* value) {
+  if (fmt[*i] == '*') {
+    long long arg = __printf_signed(__next_arg(args), status);
+
+    ++*i;
+    *value = (arg > INT_MAX) ? INT_MAX : (arg < -INT_MAX) ? -INT_MAX : arg;
+
+    return true;
+  }
+
+  if (!isdigit((unsigned char) fmt[*i]))
+    return false;
+
+  for (*value = 0; isdigit((unsigned char) fmt[*i]); ++*i) {
+    if (*value < INT_MAX / 10)
+      *value = *value * 10 + (fmt[*i] - '0');
+  }
+
+  return true;
+}
+
+// Expand the escapes of a "%b" argument. Returns a string to free or NULL if
+// memory ran out. `stop` is set if the argument held "\c".
+static char* __expand_escapes(const char* arg, bool* stop) {
+  char* expanded = malloc(strlen(arg) + 1);
+  size_t len = 0;
+
+  if (expanded == NULL)
+    return NULL;
+
+  for (size_t i = 0; arg[i] != '\0'; ) {
+    char chars[2];
+    int num_chars;
+
+    if (arg[i] != '\\') {
+      expanded[len++] = arg[i++];
+      continue;
+    }
+
+    int used = __read_escape(arg + i + 1, true, chars, &num_chars);
+
+    if (used < 0) {
+      *stop = true;
+      break;
+    }
+
+    memcpy(expanded + len, chars, num_chars);
+    len += num_chars;
+    i += used + 1;
+  }
+
+  expanded[len] = '\0';
+
+  return expanded;
+}
+
+// Print the format once, taking the arguments of its conversions from
+// `*args`. Returns false if output has to end here.
+static bool __print_format(Output* out, const char* fmt, char*** args,
+                           int* status) {
+  for (size_t i = 0; fmt[i] != '\0'; ) {
+    if (fmt[i] == '\\') {
+      char chars[2];
+      int num_chars;
+      int used = __read_escape(fmt + i + 1, false, chars, &num_chars);
+
+      if (used < 0)
+        return false;
+
+      __out_write(out, chars, num_chars);
+      i += used + 1;
+      continue;
+    }
+
+    if (fmt[i] != '%') {
+      __out_char(out, fmt[i++]);
+      continue;
+    }
+
+    if (fmt[i + 1] == '%') {
+      __out_char(out, '%');
+      i += 2;
+      continue;
+    }
+
+    // Rebuild the conversion with the width and precision filled in and a
+    // length that fits what the argument is read as
+    size_t start = i++;
+    size_t flags = i;
+    int width, precision;
+    char spec[48];
+
+    while (fmt[i] != '\0' && strchr("-+ #0", fmt[i]) != NULL)
+      ++i;
+
+    int len = snprintf(spec, sizeof(spec), "%%%.*s",
+                       (int) ((i - flags < 8) ? i - flags : 8), fmt + flags);
+
+    if (__read_field(fmt, &i, args, status, &width))
+      len += snprintf(spec + len, sizeof(spec) - len, "%d", width);
+
+    if (fmt[i] == '.') {
+      ++i;
+
+      if (!__read_field(fmt, &i, args, status, &precision))
+        precision = 0;
+
+      // A negative precision counts as none
+      if (precision >= 0)
+        len += snprintf(spec + len, sizeof(spec) - len, ".%d", precision);
+    }
+
+    char conv = fmt[i];
+    const char* arg;
+
+    switch (conv) {
+    case 'd':
+    case 'i':
+      snprintf(spec + len, sizeof(spec) - len, "ll%c", conv);
+      __out_format(out, spec, __printf_signed(__next_arg(args), status));
+      break;
+
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+      snprintf(spec + len, sizeof(spec) - len, "ll%c", conv);
+      __out_format(out, spec, __printf_unsigned(__next_arg(args), status));
+      break;
+
+    case 'a':
+    case 'A':
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+      snprintf(spec + len, sizeof(spec) - len, "%c", conv);
+      __out_format(out, spec, __printf_double(__next_arg(args), status));
+      break;
+
+    case 'c':
+      arg = __next_arg(args);
+
+      if (arg != NULL && arg[0] != '\0') {
+        snprintf(spec + len, sizeof(spec) - len, "c");
+        __out_format(out, spec, arg[0]);
+        break;
+      }
+
+      snprintf(spec + len, sizeof(spec) - len, "s");
+      __out_format(out, spec, "");
+      break;
+
+    case 's':
+      arg = __next_arg(args);
+      snprintf(spec + len, sizeof(spec) - len, "s");
+      __out_format(out, spec, (arg != NULL) ? arg : "");
+      break;
+
+    case 'b': {
+      bool stop = false;
+      char* expanded;
+
+      arg = __next_arg(args);
+      expanded = __expand_escapes((arg != NULL) ? arg : "", &stop);
+
+      if (expanded != NULL) {
+        snprintf(spec + len, sizeof(spec) - len, "s");
+        __out_format(out, spec, expanded);
+        free(expanded);
+      }
+
+      if (stop)
+        return false;
+
+      break;
+    }
+
+    default:
+      fprintf(stderr, "printf: %.*s: invalid conversion\n",
+              (int) (i - start + (conv != '\0')), fmt + start);
+      *status = 1;
+      return false;
+    }
+
+    ++i;
+  }
+
+  return true;
+}
+
+// The format is used again as long as arguments are left and it takes some
+static int __run_printf(int argc, char** argv) {
+  int first = __first_operand(argv);
+  Output out = { .len = 0, .closed = false };
+  int status = 0;
+
+  (void) argc;
+
+  if (argv[first] == NULL) {
+    fprintf(stderr, "printf: usage: printf FORMAT [ARGUMENT]...\n");
+    return 2;
+  }
+
+  const char* fmt = argv[first];
+  char** args = argv + first + 1;
+  char** before;
+
+  do {
+    before = args;
+
+    if (!__print_format(&out, fmt, &args, &status))
+      break;
+  } while (*args != NULL && args != before);
+
+  __out_finish(&out);
+
+  return status;
+}
+
+/***************************************************************************
+ * seq
+ ***************************************************************************/
+// Read an operand of seq that is a whole number
+static bool __parse_integer(const char* str, long long* out) {
+  char* end;
+
+  errno = 0;
+  *out = strtoll(str, &end, 10);
+
+  return end != str && *end == '\0' && errno == 0;
+}
+
+// Read an operand of seq that is any number
+static bool __parse_number(const char* str, long double* out) {
+  char* end;
+
+  *out = strtold(str, &end);
+
+  return end != str && *end == '\0' && !isnan(*out);
+}
+
+// Digits after the decimal point of an operand, or -1 if it has an exponent
+// and the numbers are printed in the shortest form instead
+static int __decimals(const char* str) {
+  const char* point = strchr(str, '.');
+
+  if (strpbrk(str, "eExXiInN") != NULL)
+    return -1;
+
+  return (point == NULL) ? 0 : (int) strlen(point + 1);
+}
+
+// Count up or down in whole numbers. Stops early if the next number would not
+// fit or nobody reads the output anymore.
+static void __seq_integers(Output* out, long long first, long long step,
+                           long long last, const char* sep, int width) {
+  size_t sep_len = strlen(sep);
+  bool any = false;
+
+  for (long long value = first; (step > 0) ? value <= last : value >= last; ) {
+    if (any)
+      __out_write(out, sep, sep_len);
+
+    __out_format(out, "%0*lld", width, value);
+    any = true;
+
+    if (out->closed || __builtin_add_overflow(value, step, &value))
+      break;
+  }
+
+  if (any)
+    __out_char(out, '\n');
+}
+
+// Count with fractions. Each number is computed from the first one so the
+// error of adding the step does not build up.
+static void __seq_numbers(Output* out, long double first, long double step,
+                          long double last, const char* sep, int width,
+                          int decimals) {
+  size_t sep_len = strlen(sep);
+  bool any = false;
+
+  for (unsigned long long k = 0; !out->closed; ++k) {
+    long double value = first + k * step;
+
+    if ((step > 0) ? value > last : value < last)
+      break;
+
+    if (any)
+      __out_write(out, sep, sep_len);
+
+    if (decimals < 0)
+      __out_format(out, "%0*Lg", width, value);
+    else
+      __out_format(out, "%0*.*Lf", width, decimals, value);
+
+    any = true;
+  }
+
+  if (any)
+    __out_char(out, '\n');
+}
+
+static int __run_seq(int argc, char** argv) {
+  const char* sep = "\n";
+  bool equal_width = false;
+  int i = 1;
+
+  // Negative numbers are operands and not options
+  while (i < argc && argv[i][0] == '-' && argv[i][1] != '\0'
+         && !isdigit((unsigned char) argv[i][1]) && argv[i][1] != '.') {
+    if (strcmp(argv[i], "--") == 0) {
+      ++i;
+      break;
+    }
+    else if (strcmp(argv[i], "-w") == 0) {
+      equal_width = true;
+      ++i;
+    }
+    else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+      sep = argv[i + 1];
+      i += 2;
+    }
+    else {
+      fprintf(stderr, "seq: invalid option '%s'\n", argv[i]);
+      return 1;
+    }
+  }
+
+  int num = argc - i;
+
+  if (num < 1 || num > 3) {
+    fprintf(stderr, "seq: usage: seq [-w] [-s SEP] [FIRST [INCREMENT]] LAST\n");
+    return 1;
+  }
+
+  const char* first = (num > 1) ? argv[i] : "1";
+  const char* step = (num > 2) ? argv[i + 1] : "1";
+  const char* last = argv[argc - 1];
+  Output out = { .len = 0, .closed = false };
+  long long int_first, int_step, int_last;
+  long double num_first, num_step, num_last;
+  int width = 0;
+
+  if (__parse_integer(first, &int_first) && __parse_integer(step, &int_step)
+      && __parse_integer(last, &int_last) && int_step != 0) {
+    if (equal_width) {
+      int a = snprintf(NULL, 0, "%lld", int_first);
+      int b = snprintf(NULL, 0, "%lld", int_last);
+
+      width = (a > b) ? a : b;
+    }
+
+    __seq_integers(&out, int_first, int_step, int_last, sep, width);
+    __out_finish(&out);
+
+    return 0;
+  }
+
+  const char* operands[] = { first, step, last };
+  long double* values[] = { &num_first, &num_step, &num_last };
+
+  for (int k = 0; k < 3; ++k) {
+    if (!__parse_number(operands[k], values[k])) {
+      fprintf(stderr, "seq: invalid floating point argument: '%s'\n",
+              operands[k]);
+      return 1;
+    }
+  }
+
+  if (num_step == 0) {
+    fprintf(stderr, "seq: invalid Zero increment value: '%s'\n", step);
+    return 1;
+  }
+
+  int first_decimals = __decimals(first);
+  int step_decimals = __decimals(step);
+  int decimals = (first_decimals < 0 || step_decimals < 0) ? -1
+                 : (first_decimals > step_decimals) ? first_decimals
+                 : step_decimals;
+
+  if (equal_width) {
+    int a = (decimals < 0) ? snprintf(NULL, 0, "%Lg", num_first)
+            : snprintf(NULL, 0, "%.*Lf", decimals, num_first);
+    int b = (decimals < 0) ? snprintf(NULL, 0, "%Lg", num_last)
+            : snprintf(NULL, 0, "%.*Lf", decimals, num_last);
+
+    width = (a > b) ? a : b;
+  }
+
+  __seq_numbers(&out, num_first, num_step, num_last, sep, width, decimals);
+  __out_finish(&out);
+
+  return 0;
+}
+
+/***************************************************************************
+ * basename and dirname
+ ***************************************************************************/
+static int __run_basename(int argc, char** argv) {
+  int i = __first_operand(argv);
+
+  if (argc - i < 1 || argc - i > 2) {
+    fprintf(stderr, "basename: usage: basename NAME [SUFFIX]\n");
+    return 1;
+  }
+
+  const char* path = argv[i];
+  const char* suffix = argv[i + 1];
+  size_t end = strlen(path);
+  size_t start;
+
+  // Trailing slashes are not part of the name, but "/" is named "/"
+  while (end > 1 && path[end - 1] == '/')
+    --end;
+
+  for (start = end; start > 0 && path[start - 1] != '/'; --start);
+
+  if (start == end && end > 0)
+    --start;
+
+  size_t len = end - start;
+
+  // A suffix that is the whole name stays
+  if (suffix != NULL) {
+    size_t suffix_len = strlen(suffix);
+
+    if (suffix_len < len
+        && memcmp(path + start + len - suffix_len, suffix, suffix_len) == 0)
+      len -= suffix_len;
+  }
+
+  Output out = { .len = 0, .closed = false };
+
+  __out_write(&out, path + start, len);
+  __out_char(&out, '\n');
+  __out_finish(&out);
+
+  return 0;
+}
+
+// Every name gets a line
+static int __run_dirname(int argc, char** argv) {
+  int i = __first_operand(argv);
+  Output out = { .len = 0, .closed = false };
+
+  if (i >= argc) {
+    fprintf(stderr, "dirname: usage: dirname NAME...\n");
+    return 1;
+  }
+
+  for (; i < argc; ++i) {
+    const char* path = argv[i];
+    size_t end = strlen(path);
+
+    // Drop trailing slashes, the last name and the slashes before it
+    while (end > 1 && path[end - 1] == '/')
+      --end;
+
+    while (end > 0 && path[end - 1] != '/')
+      --end;
+
+    while (end > 1 && path[end - 1] == '/')
+      --end;
+
+    if (end == 0)
+      __out_char(&out, '.');
+    else
+      __out_write(&out, path, end);
+
+    __out_char(&out, '\n');
+  }
+
+  __out_finish(&out);
+
+  return 0;
+}
+
+/***************************************************************************
+ * sleep
+ ***************************************************************************/
+bool parse_duration(const char* str, struct timespec* out) {
+  char* end;
+  double seconds = strtod(str, &end);
+
+  if (end == str || !isfinite(seconds) || seconds < 0)
+    return false;
+
+  switch (*end) {
+  case 'd':
+    seconds *= 24;
+    // fall through
+  case 'h':
+    seconds *= 60;
+    // fall through
+  case 'm':
+    seconds *= 60;
+    // fall through
+  case 's':
+    ++end;
+    // fall through
+  case '\0':
+    break;
+
+  default:
+    return false;
+  }
+
+  if (*end != '\0' || seconds > (double) (1L << 40))
+    return false;
+
+  out->tv_sec = (time_t) seconds;
+  out->tv_nsec = (long) ((seconds - out->tv_sec) * 1e9);
+
+  return true;
+}
+
+// Sleep for the sum of the durations
+static int __run_sleep(int argc, char** argv) {
+  struct timespec total = { 0, 0 };
+  int i = __first_operand(argv);
+
+  if (i >= argc) {
+    fprintf(stderr, "sleep: usage: sleep NUMBER[SUFFIX]...\n");
+    return 1;
+  }
+
+  for (; i < argc; ++i) {
+    struct timespec duration;
+
+    if (!parse_duration(argv[i], &duration)) {
+      fprintf(stderr, "sleep: invalid time interval '%s'\n", argv[i]);
+      return 1;
+    }
+
+    total.tv_sec += duration.tv_sec;
+    total.tv_nsec += duration.tv_nsec;
+
+    if (total.tv_nsec >= 1000000000L) {
+      total.tv_nsec -= 1000000000L;
+      ++total.tv_sec;
+    }
+  }
+
+  while (nanosleep(&total, &total) < 0 && errno == EINTR);
+
+  return 0;
+}
+
+/***************************************************************************
+ * Dispatch
+ ***************************************************************************/
+/**
+ * @brief The utilities by the name they are called with
+ */
+static const struct {
+  const char* name;                  /**< Name of the program */
+  int (*run)(int argc, char** argv); /**< Runs it and returns its status */
+} utilities[] = {
+  { "true", __run_true },
+  { "false", __run_false },
+  { "test", __run_test },
+  { "[", __run_test },
+  { "printf", __run_printf },
+  { "seq", __run_seq },
+  { "basename", __run_basename },
+  { "dirname", __run_dirname },
+  { "sleep", __run_sleep },
+};
+
+#define NUM_UTILITIES (sizeof(utilities) / sizeof(utilities[0]))
+
+bool is_utility(const char* name) {
+  for (size_t i = 0; i < NUM_UTILITIES; ++i) {
+    if (strcmp(name, utilities[i].name) == 0)
+      return true;
+  }
+
+  return false;
+}
+
+bool utility_sleeps(UtilityCommand cmd) {
+  return strcmp(cmd.args[0], "sleep") == 0;
+}
+
+int run_utility(UtilityCommand cmd) {
+  int argc = 0;
+
+  while (cmd.args[argc] != NULL)
+    ++argc;
+
+  for (size_t i = 0; i < NUM_UTILITIES; ++i) {
+    if (strcmp(cmd.args[0], utilities[i].name) == 0)
+      return utilities[i].run(argc, cmd.args);
+  }
+
+  return 127;
+}
@@ -0,0 +1,68 @@
+/**
+ * @file utilities.h
+ *
+ * @brief Small programs that quash runs without starting a process
+ *
+ * Scripts call true, false, test, [, printf, seq, basename, dirname and sleep
+ * over and over, and each call does microseconds of work. Forking and
+ * executing the program costs far more than that, so quash carries its own
+ * versions. They take the same arguments as the POSIX tools, return the same
+ * exit status and write through builtin_io.h so they also work as a stage of
+ * a pipeline.
+ */
+
+#ifndef SRC_UTILITIES_H
+#define SRC_UTILITIES_H
+
+#include <stdbool.h>
+#include <time.h>
+
+#include "command.h"
+
+/**
+ * @brief Check whether quash carries its own version of a program
+ *
+ * @param name Name of the program as typed
+ *
+ * @return True if run_utility() can run @a name
+ */
+bool is_utility(const char* name);
+
+/**
+ * @brief Check whether a utility may keep quash busy for a long time
+ *
+ * Only sleep does. Quash must not run it in place while it has jobs to look
+ * after or while the terminal could interrupt it.
+ *
+ * @param cmd A @a UtilityCommand
+ *
+ * @return True if @a cmd is a sleep
+ */
+bool utility_sleeps(UtilityCommand cmd);
+
+/**
+ * @brief Run a utility in the calling thread
+ *
+ * Output goes through builtin_write() and errors to standard error.
+ *
+ * @param cmd A @a UtilityCommand
+ *
+ * @return The exit status the program of the same name would have
+ *
+ * @sa UtilityCommand
+ */
+int run_utility(UtilityCommand cmd);
+
+/**
+ * @brief Read a duration like sleep(1) and timeout(1) take it
+ *
+ * @param str A non-negative number of seconds with an optional suffix of "s",
+ * "m", "h" or "d"
+ *
+ * @param out Where the duration goes
+ *
+ * @return True if @a str is a valid duration
+ */
+bool parse_duration(const char* str, struct timespec* out);
+
+#endif
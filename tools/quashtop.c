@@ -0,0 +1,314 @@
+/**
+ * @file quashtop.c
+ *
+ * @brief Lists the jobs of every quash that publishes its job table
+ *
+ * A quash running with QUASH_JOB_TABLE set keeps a copy of its jobs in
+ * /dev/shm/quash-PID, laid out as described in shm_jobs.h. quashtop maps each
+ * of these objects and copies the table out under its sequence lock. The
+ * shells never notice, no matter how often it runs. Tables left behind by a
+ * quash that was killed are skipped.
+ *
+ * Output is one tab separated line per job. A shell without jobs gets a line
+ * of its own with "-" in place of the job.
+ *
+ * Usage: quashtop [-p PID] [-i SECONDS]
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_jobs.h"
+
+// Where Linux shows POSIX shared memory objects
+#define SHM_DIR "/dev/shm"
+
+// Reads given up on while a shell keeps rewriting its table
+#define MAX_TRIES 1000
+
+/**
+ * @brief A consistent copy of the table of one shell
+ */
+typedef struct Snapshot {
+  QuashShmHeader header; /**< Header as it was when the jobs were copied */
+  QuashShmJob* jobs;     /**< @a header.num_jobs entries */
+} Snapshot;
+
+static const char* state_names[] = { "Pending", "Running", "Stopped", "Done" };
+
+// Map the whole object behind fd. Returns NULL if it is too small to hold a
+// header.
+static void* map_table(int fd, size_t* size) {
+  struct stat st;
+  void* map;
+
+  if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(QuashShmHeader))
+    return NULL;
+
+  map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+  if (map == MAP_FAILED)
+    return NULL;
+
+  *size = st.st_size;
+
+  return map;
+}
+
+// Copy the table of one shell out of shared memory. The copy is kept if the
+// sequence did not move while it was made. A table that grew past what is
+// mapped is mapped again.
+static bool read_table(const char* path, Snapshot* snap) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  size_t size = 0;
+  void* map = (fd >= 0) ? map_table(fd, &size) : NULL;
+  bool ok = false;
+
+  snap->jobs = NULL;
+
+  for (int tries = 0; map != NULL && tries < MAX_TRIES; ++tries) {
+    const QuashShmHeader* shared = map;
+    const QuashShmJob* entries = (const QuashShmJob*) (shared + 1);
+    uint32_t seq = __atomic_load_n(&shared->seq, __ATOMIC_ACQUIRE);
+
+    if (seq & 1)
+      continue;
+
+    snap->header = *shared;
+
+    if (snap->header.magic != QUASH_SHM_MAGIC
+        || snap->header.version != QUASH_SHM_VERSION)
+      break;
+
+    size_t need = sizeof(QuashShmHeader)
+                  + (size_t) snap->header.num_jobs * sizeof(QuashShmJob);
+
+    if (need > size) {
+      munmap(map, size);
+      map = map_table(fd, &size);
+      continue;
+    }
+
+    QuashShmJob* jobs = realloc(snap->jobs,
+                                (snap->header.num_jobs + 1) * sizeof(QuashShmJob));
+
+    if (jobs == NULL)
+      break;
+
+    snap->jobs = jobs;
+    memcpy(jobs, entries, snap->header.num_jobs * sizeof(QuashShmJob));
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n(&shared->seq, __ATOMIC_RELAXED) == seq) {
+      ok = true;
+      break;
+    }
+  }
+
+  if (map != NULL)
+    munmap(map, size);
+
+  if (fd >= 0)
+    close(fd);
+
+  if (!ok) {
+    free(snap->jobs);
+    snap->jobs = NULL;
+  }
+
+  return ok;
+}
+
+// Format how long a job has been running like ps does, [[DD-]HH:]MM:SS
+static void format_elapsed(char* buf, size_t len, const QuashShmJob* job,
+                           const struct timespec* now) {
+  if (job->start_sec == 0) {
+    snprintf(buf, len, "-");
+    return;
+  }
+
+  long secs = (now->tv_sec > job->start_sec) ? now->tv_sec - job->start_sec : 0;
+  long days = secs / 86400;
+  long hours = secs / 3600 % 24;
+  long mins = secs / 60 % 60;
+
+  secs %= 60;
+
+  if (days > 0)
+    snprintf(buf, len, "%ld-%02ld:%02ld:%02ld", days, hours, mins, secs);
+  else if (hours > 0)
+    snprintf(buf, len, "%02ld:%02ld:%02ld", hours, mins, secs);
+  else
+    snprintf(buf, len, "%02ld:%02ld", mins, secs);
+}
+
+// List the pids of a job separated by commas. Pids that did not fit in the
+// table are counted at the end.
+static void format_pids(char* buf, size_t len, const QuashShmJob* job) {
+  size_t listed = (job->num_pids < QUASH_SHM_PIDS) ? job->num_pids
+                                                   : QUASH_SHM_PIDS;
+  size_t used = 0;
+
+  buf[0] = '\0';
+
+  if (job->num_pids == 0) {
+    snprintf(buf, len, "-");
+    return;
+  }
+
+  for (size_t i = 0; i < listed && used < len; ++i)
+    used += snprintf(buf + used, len - used, "%s%d", (i > 0) ? "," : "",
+                     job->pids[i]);
+
+  if (job->num_pids > listed && used < len)
+    snprintf(buf + used, len - used, ",+%u", job->num_pids - (unsigned) listed);
+}
+
+// Print the jobs of one shell
+static void print_shell(const Snapshot* snap, const struct timespec* now) {
+  char elapsed[32];
+  char pids[QUASH_SHM_PIDS * 12 + 16];
+
+  if (snap->header.num_jobs == 0) {
+    printf("%8d\t-\t-\tIdle\t-\t-\t-\n", snap->header.shell_pid);
+    return;
+  }
+
+  for (uint32_t i = 0; i < snap->header.num_jobs; ++i) {
+    const QuashShmJob* job = &snap->jobs[i];
+    const char* state = (job->state < 4) ? state_names[job->state] : "?";
+
+    format_elapsed(elapsed, sizeof(elapsed), job, now);
+    format_pids(pids, sizeof(pids), job);
+
+    printf("%8d\t[%d]\t%8d\t%s\t%s\t%s\t%.*s\n", snap->header.shell_pid,
+           job->id, job->pgid, state, elapsed, pids, QUASH_SHM_CMD - 1,
+           job->cmd);
+  }
+}
+
+// Order shells by pid
+static int compare_pids(const void* a, const void* b) {
+  pid_t x = *(const pid_t*) a;
+  pid_t y = *(const pid_t*) b;
+
+  return (x > y) - (x < y);
+}
+
+// Print every shell, or only `only` if it is not 0
+static void print_all(pid_t only) {
+  DIR* dir = opendir(SHM_DIR);
+  struct dirent* ent;
+  pid_t* shells = NULL;
+  size_t num_shells = 0;
+  size_t cap = 0;
+  struct timespec now;
+
+  if (dir == NULL) {
+    perror("quashtop: " SHM_DIR);
+    exit(EXIT_FAILURE);
+  }
+
+  size_t prefix = strlen(QUASH_SHM_PREFIX);
+
+  while ((ent = readdir(dir)) != NULL) {
+    char* end;
+
+    if (strncmp(ent->d_name, QUASH_SHM_PREFIX, prefix) != 0)
+      continue;
+
+    long pid = strtol(ent->d_name + prefix, &end, 10);
+
+    if (*end != '\0' || pid <= 0 || (only != 0 && pid != only))
+      continue;
+
+    if (num_shells == cap) {
+      cap = (cap == 0) ? 16 : cap * 2;
+
+      if ((shells = realloc(shells, cap * sizeof(pid_t))) == NULL) {
+        perror("quashtop");
+        exit(EXIT_FAILURE);
+      }
+    }
+
+    shells[num_shells++] = pid;
+  }
+
+  closedir(dir);
+  qsort(shells, num_shells, sizeof(pid_t), compare_pids);
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  printf("SHELL\tJOB\tPGID\tSTATE\tTIME\tPIDS\tCOMMAND\n");
+
+  for (size_t i = 0; i < num_shells; ++i) {
+    char path[64];
+    Snapshot snap;
+
+    snprintf(path, sizeof(path), SHM_DIR "/" QUASH_SHM_PREFIX "%d", shells[i]);
+
+    // A quash that was killed could not remove its table
+    if (kill(shells[i], 0) < 0 && errno == ESRCH)
+      continue;
+
+    if (!read_table(path, &snap))
+      continue;
+
+    print_shell(&snap, &now);
+    free(snap.jobs);
+  }
+
+  free(shells);
+  fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+  double interval = 0;
+  pid_t only = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "p:i:")) != -1) {
+    switch (opt) {
+    case 'p':
+      only = atoi(optarg);
+      break;
+
+    case 'i':
+      interval = atof(optarg);
+      break;
+
+    default:
+      fprintf(stderr, "Usage: %s [-p PID] [-i SECONDS]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (interval <= 0) {
+    print_all(only);
+    return EXIT_SUCCESS;
+  }
+
+  // Refresh in place like top until interrupted
+  struct timespec pause = {
+    (time_t) interval,
+    (long) ((interval - (time_t) interval) * 1e9)
+  };
+
+  for (;;) {
+    printf("\033[H\033[J");
+    print_all(only);
+    nanosleep(&pause, NULL);
+  }
+}